@@ -9,6 +9,39 @@
 #include <ctime>
 #include <optional>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <list>
+#include <set>
+#include <queue>
+#include <coroutine>
+#include <utility>
+#include <unordered_map>
+#include <unordered_set>
+#include <cctype>
+#include <cstdint>
+#include <complex>
+#include <future>
+#include <memory>
+#include <cstdio>
+#include <fstream>
+#include <deque>
+#include <cstring>
+#include <memory_resource>
+#include <tuple>
+#include <type_traits>
+#include <chrono>
+#include <string_view>
+#include <new>
+#include "QuantumSimShm.hpp"
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 struct Element {
     std::string name;
@@ -36,104 +69,5562 @@ struct Electron {
     float speed; // radians/sec
 };
 
-struct Atom {
-    int id;
-    int elementIndex;
-    sf::Vector2f pos;
-    float nucleusRadius = 16.f;
-    bool active = false;
-    bool selected = false;
-    std::vector<Electron> electrons;
-    std::optional<float> scheduledStart; // seconds since sim start
+// ---- Entity storage ----
+
+// Archetype ECS: every distinct set of components gets its own table with one
+// column per component, and each entity is one row of exactly one table. A
+// query walks only the tables whose set covers what it asks for, column by
+// column. Adding or removing a component moves the row to the table for the
+// new set. The world also keeps its entities in a dense creation order, so
+// code that indexes "the i-th entity" is unaffected by those moves.
+// Structural calls (create, add, remove, destroy) must not run inside each().
+using Entity = uint32_t;
+
+template <class... Cs>
+class ArchetypeWorld {
+public:
+    using Mask = uint32_t;
+    static_assert(sizeof...(Cs) <= 32, "one mask bit per component");
+
+    template <class C> static constexpr Mask bit() { return Mask(1) << indexOf<C>(); }
+    template <class... Qs> static constexpr Mask maskOf() { return (Mask(0) | ... | bit<Qs>()); }
+
+    size_t size() const { return order.size(); }
+    Entity entity(size_t i) const { return order[i]; }
+    size_t indexOf(Entity e) const { return where[e].rank; }
+    size_t tableCount() const { return tables.size(); }
+
+    template <class... With>
+    Entity create(With&&... components) {
+        Entity e;
+        if (!freeSlots.empty()) { e = freeSlots.back(); freeSlots.pop_back(); }
+        else { e = (Entity)where.size(); where.push_back({}); }
+        int ti = tableFor(maskOf<std::decay_t<With>...>());
+        Table& t = tables[ti];
+        (column<std::decay_t<With>>(t).push_back(std::forward<With>(components)), ...);
+        where[e] = {ti, t.entities.size(), order.size()};
+        t.entities.push_back(e);
+        order.push_back(e);
+        return e;
+    }
+
+    template <class C> bool has(Entity e) const { return tables[where[e].table].mask & bit<C>(); }
+    template <class C> C& get(Entity e) { return column<C>(tables[where[e].table])[where[e].row]; }
+    template <class C> const C& get(Entity e) const { return column<C>(tables[where[e].table])[where[e].row]; }
+
+    template <class C>
+    C& add(Entity e, C value) {
+        if (has<C>(e)) return get<C>(e) = std::move(value);
+        move(e, tables[where[e].table].mask | bit<C>());
+        Table& t = tables[where[e].table];
+        column<C>(t).push_back(std::move(value));
+        return column<C>(t).back();
+    }
+
+    template <class C>
+    void remove(Entity e) {
+        if (has<C>(e)) move(e, tables[where[e].table].mask & ~bit<C>());
+    }
+
+    // Calls f(entity, components...) for every entity that has all of Qs
+    template <class... Qs, class F>
+    void each(F&& f) {
+        const Mask need = maskOf<Qs...>();
+        for (Table& t : tables) {
+            if ((t.mask & need) != need) continue;
+            for (size_t r = 0; r < t.entities.size(); ++r) f(t.entities[r], column<Qs>(t)[r]...);
+        }
+    }
+
+    // Destroys every entity for which pred(entity) holds; the rest keep their order
+    template <class Pred>
+    size_t destroyIf(Pred pred) {
+        size_t kept = 0, n = order.size();
+        for (size_t i = 0; i < n; ++i) {
+            Entity e = order[i];
+            if (pred(e)) {
+                eraseRow(where[e].table, where[e].row);
+                where[e].table = -1;
+                freeSlots.push_back(e);
+            } else {
+                where[e].rank = kept;
+                order[kept++] = e;
+            }
+        }
+        order.resize(kept);
+        return n - kept;
+    }
+
+    void clear() {
+        tables.clear();
+        where.clear();
+        freeSlots.clear();
+        order.clear();
+    }
+
+private:
+    struct Table {
+        Mask mask = 0;
+        std::vector<Entity> entities;
+        std::tuple<std::vector<Cs>...> columns; // only the mask's columns are filled
+    };
+    struct Location {
+        int table = -1;
+        size_t row = 0;
+        size_t rank = 0; // index in order
+    };
+
+    template <class C, size_t I = 0>
+    static constexpr size_t indexOf() {
+        using T = std::tuple_element_t<I, std::tuple<Cs...>>;
+        if constexpr (std::is_same_v<T, C>) return I;
+        else return indexOf<C, I + 1>();
+    }
+
+    template <class C> static std::vector<C>& column(Table& t) { return std::get<std::vector<C>>(t.columns); }
+    template <class C> static const std::vector<C>& column(const Table& t) { return std::get<std::vector<C>>(t.columns); }
+
+    int tableFor(Mask mask) {
+        for (size_t i = 0; i < tables.size(); ++i) if (tables[i].mask == mask) return (int)i;
+        tables.emplace_back();
+        tables.back().mask = mask;
+        return (int)tables.size() - 1;
+    }
+
+    // Swap-removes a row; the entity moved into its place gets its new row
+    void eraseRow(int ti, size_t row) {
+        Table& t = tables[ti];
+        size_t last = t.entities.size() - 1;
+        auto eraseColumn = [&](auto& col){
+            if (col.empty()) return;
+            if (row != last) col[row] = std::move(col[last]);
+            col.pop_back();
+        };
+        std::apply([&](auto&... cols){ (eraseColumn(cols), ...); }, t.columns);
+        if (row != last) {
+            t.entities[row] = t.entities[last];
+            where[t.entities[row]].row = row;
+        }
+        t.entities.pop_back();
+    }
+
+    // Moves e's row to the table for `mask`, carrying the components both share
+    void move(Entity e, Mask mask) {
+        int from = where[e].table, to = tableFor(mask);
+        size_t row = where[e].row;
+        Table& src = tables[from];
+        Table& dst = tables[to];
+        auto carry = [&](auto& dcol, auto& scol){
+            using C = typename std::decay_t<decltype(dcol)>::value_type;
+            if ((src.mask & bit<C>()) && (mask & bit<C>())) dcol.push_back(std::move(scol[row]));
+        };
+        [&]<size_t... I>(std::index_sequence<I...>){
+            (carry(std::get<I>(dst.columns), std::get<I>(src.columns)), ...);
+        }(std::index_sequence_for<Cs...>());
+        where[e].table = to;
+        where[e].row = dst.entities.size();
+        dst.entities.push_back(e);
+        eraseRow(from, row); // fills the hole; e's own location is already updated
+    }
+
+    std::vector<Table> tables;
+    std::vector<Location> where; // per entity slot; table -1 when free
+    std::vector<Entity> freeSlots;
+    std::vector<Entity> order;   // live entities, creation order
+};
+
+// Atom components. Every atom has the first eight; Scheduled is only present
+// while a timeline holds an activation for the atom.
+struct AtomId      { int id = 0; };
+struct Species     { int elementIndex = 0; };
+struct Position    { sf::Vector2f pos; };
+struct NucleusSize { float radius = 16.f; };
+struct Activity    { bool active = false; };
+struct Selection   { bool selected = false; };
+struct Shells      { std::vector<Electron> electrons; };
+struct Glow        { float flash = 0.f; }; // brightens the outline after absorbing a photon, decays
+struct Scheduled   { int pending = 0; };   // activations still waiting
+
+using AtomWorld = ArchetypeWorld<AtomId, Species, Position, NucleusSize, Activity, Selection, Shells, Glow, Scheduled>;
+
+// One atom's core components, by reference, so engine code reads `a.pos` and
+// `a.active` straight out of the world's columns
+template <bool Const>
+struct BasicAtomRef {
+    template <class T> using Ref = std::conditional_t<Const, const T&, T&>;
+    Entity entity;
+    Ref<int> id;
+    Ref<int> elementIndex;
+    Ref<sf::Vector2f> pos;
+    Ref<float> nucleusRadius;
+    Ref<bool> active;
+    Ref<bool> selected;
+    Ref<std::vector<Electron>> electrons;
+    Ref<float> flash;
+
+    operator BasicAtomRef<true>() const requires (!Const) {
+        return {entity, id, elementIndex, pos, nucleusRadius, active, selected, electrons, flash};
+    }
+};
+using AtomRef = BasicAtomRef<false>;
+using AtomView = BasicAtomRef<true>;
+
+// The scene's atoms: entities of an AtomWorld in creation order, indexable
+// like the vector they replace, plus an id index
+class AtomStore {
+public:
+    static constexpr Entity NONE = ~0u;
+
+    template <bool Const>
+    class Iterator {
+    public:
+        using Store = std::conditional_t<Const, const AtomStore, AtomStore>;
+        using iterator_category = std::input_iterator_tag;
+        using value_type = BasicAtomRef<Const>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = BasicAtomRef<Const>;
+
+        Iterator(Store* s, size_t i) : s(s), i(i) {}
+        reference operator*() const { return (*s)[i]; }
+        Iterator& operator++() { ++i; return *this; }
+        Iterator operator++(int) { Iterator t = *this; ++i; return t; }
+        bool operator==(const Iterator& o) const { return i == o.i; }
+        bool operator!=(const Iterator& o) const { return i != o.i; }
+
+    private:
+        Store* s;
+        size_t i;
+    };
+
+    size_t size() const { return w.size(); }
+    bool empty() const { return w.size() == 0; }
+    AtomRef operator[](size_t i) { return ref(w.entity(i)); }
+    AtomView operator[](size_t i) const { return view(w.entity(i)); }
+    Iterator<false> begin() { return {this, 0}; }
+    Iterator<false> end() { return {this, size()}; }
+    Iterator<true> begin() const { return {this, 0}; }
+    Iterator<true> end() const { return {this, size()}; }
+
+    AtomRef ref(Entity e) {
+        return {e, w.get<AtomId>(e).id, w.get<Species>(e).elementIndex, w.get<Position>(e).pos, w.get<NucleusSize>(e).radius,
+                w.get<Activity>(e).active, w.get<Selection>(e).selected, w.get<Shells>(e).electrons, w.get<Glow>(e).flash};
+    }
+    AtomView view(Entity e) const {
+        return {e, w.get<AtomId>(e).id, w.get<Species>(e).elementIndex, w.get<Position>(e).pos, w.get<NucleusSize>(e).radius,
+                w.get<Activity>(e).active, w.get<Selection>(e).selected, w.get<Shells>(e).electrons, w.get<Glow>(e).flash};
+    }
+
+    AtomRef add(int id, int elementIndex, sf::Vector2f pos, std::vector<Electron> electrons = {}, bool active = false) {
+        Entity e = w.create(AtomId{id}, Species{elementIndex}, Position{pos}, NucleusSize{}, Activity{active},
+                            Selection{}, Shells{std::move(electrons)}, Glow{});
+        byId[id] = e;
+        return ref(e);
+    }
+
+    // Removes the atoms pred(AtomView) picks; the others keep their order
+    template <class Pred>
+    size_t removeIf(Pred pred) {
+        return w.destroyIf([&](Entity e){
+            AtomView a = view(e);
+            if (!pred(a)) return false;
+            byId.erase(a.id);
+            return true;
+        });
+    }
+
+    void clear() {
+        w.clear();
+        byId.clear();
+    }
+
+    size_t indexOf(Entity e) const { return w.indexOf(e); }
+
+    Entity find(int id) const {
+        auto it = byId.find(id);
+        return it == byId.end() ? NONE : it->second;
+    }
+
+    AtomWorld& world() { return w; }
+    const AtomWorld& world() const { return w; }
+
+private:
+    AtomWorld w;
+    std::unordered_map<int, Entity> byId;
+};
+
+struct Link {
+    int aId;
+    int bId;
+    int order = 1; // 1 single, 2 double, 3 triple bond
+};
+
+struct Button {
+    sf::RectangleShape box;
+    sf::Text label;
+    std::function<void()> onClick;
+    bool hover = false;
+    const bool* toggled = nullptr; // mode buttons light up while their flag is set
+};
+
+static const float SIDEBAR_W = 320.f;
+
+// ---- Embedded UI font ----
+// DejaVuSans.ttf is compiled into the binary so text renders from any working directory.
+// The byte list is generated at build time, not kept in the tree (see the README):
+//   xxd -i < DejaVuSans.ttf > DejaVuSans.ttf.inc
+// Without it, or with -DQS_NO_EMBEDDED_FONT, the font is only loaded from disk.
+#if !defined(QS_NO_EMBEDDED_FONT) && __has_include("DejaVuSans.ttf.inc")
+static const unsigned char qsEmbeddedFont[] = {
+#include "DejaVuSans.ttf.inc"
+};
+#define QS_HAVE_EMBEDDED_FONT 1
+#endif
+
+// Sizes used by makeText/makeButton; their glyphs are rasterized before the first frame
+static const unsigned UI_FONT_SIZES[] = { 12, 14, 16, 18 };
+
+bool loadUiFont(sf::Font& font) {
+#ifdef QS_HAVE_EMBEDDED_FONT
+    if (font.loadFromMemory(qsEmbeddedFont, sizeof(qsEmbeddedFont))) return true;
+#endif
+    return font.loadFromFile("DejaVuSans.ttf");
+}
+
+// Rasterizes printable ASCII at every UI size into the font's glyph pages. Runs on its own
+// thread with its own GL context while main() builds the scene; nothing else may touch the
+// font until it returns.
+void prewarmGlyphs(const sf::Font& font) {
+    sf::Context context;
+    for (unsigned size : UI_FONT_SIZES) {
+        for (sf::Uint32 c = 32; c < 127; ++c) font.getGlyph(c, size, false);
+    }
+}
+
+sf::Text makeText(const std::string& s, const sf::Font& font, unsigned size, sf::Color color, sf::Vector2f pos) {
+    sf::Text t;
+    t.setFont(font);
+    t.setString(s);
+    t.setCharacterSize(size);
+    t.setFillColor(color);
+    t.setPosition(pos);
+    return t;
+}
+
+Button makeButton(const std::string& label, const sf::Font& font, const sf::Vector2f& pos, const sf::Vector2f& size, std::function<void()> onClick) {
+    Button b;
+    b.box.setPosition(pos);
+    b.box.setSize(size);
+    b.box.setFillColor(sf::Color(40,40,50));
+    b.box.setOutlineThickness(1.f);
+    b.box.setOutlineColor(sf::Color(90,90,110));
+    b.label = makeText(label, font, 16, sf::Color::White, {pos.x + 12, pos.y + 8});
+    b.onClick = std::move(onClick);
+    return b;
+}
+
+bool pointInRect(const sf::Vector2f& p, const sf::FloatRect& r) {
+    return r.contains(p);
+}
+
+float length(const sf::Vector2f& v) {
+    return std::sqrt(v.x*v.x + v.y*v.y);
+}
+
+sf::Vector2f clampToCanvas(const sf::Vector2f& p, const sf::Vector2u& winSize) {
+    float x = std::clamp(p.x, SIDEBAR_W + 20.f, (float)winSize.x - 20.f);
+    float y = std::clamp(p.y, 20.f, (float)winSize.y - 20.f);
+    return {x, y};
+}
+
+// Shared by the window and the software renderer so both draw the same thing
+sf::Color nucleusOutlineColor(AtomView a) {
+    sf::Color outline = a.active ? sf::Color(255,255,180) : sf::Color(90,90,110);
+    if (a.flash > 0.f) {
+        outline.r = (sf::Uint8)(outline.r + (255 - outline.r) * a.flash);
+        outline.g = (sf::Uint8)(outline.g + (255 - outline.g) * a.flash);
+        outline.b = (sf::Uint8)(outline.b + (255 - outline.b) * a.flash);
+    }
+    return outline;
+}
+
+std::pmr::string atomListRow(AtomView a, std::pmr::memory_resource* mem = std::pmr::get_default_resource()) {
+    char id[16];
+    std::snprintf(id, sizeof id, "ID %d  ", a.id);
+    std::pmr::string row(id, mem);
+    row += ELEMENTS[a.elementIndex].symbol;
+    row += a.active ? "  [Active]" : "  [Idle]";
+    return row;
+}
+
+// An sf::Text kept across frames. SFML converts every setString to a fresh UTF-32
+// copy, so set() only forwards the string when its content changed.
+struct TextLine {
+    sf::Text text;
+    std::string shown;
+
+    void set(std::string_view s) {
+        if (s == shown) return;
+        shown.assign(s.data(), s.size());
+        text.setString(shown);
+    }
+};
+
+// ---- Allocation counting ----
+
+// Global operator new/delete are replaced in QuantumSimAlloc.cpp so every heap
+// allocation in the process, SFML's included, bumps these counters.
+extern std::atomic<uint64_t> heapAllocations, heapBytes;
+
+// ---- Hardware performance counters ----
+
+// Cycles, instructions, L1D read misses, last-level cache misses and branch misses
+// of the calling thread, as one perf_event group. Counters the kernel refuses
+// (perf_event_paranoid, containers, VMs without a PMU, non-Linux builds) are left
+// out; available(i) says which ones count and read() leaves the others at zero.
+class PerfCounters {
+public:
+    enum Counter { Cycles, Instructions, L1Misses, LlcMisses, BranchMisses, COUNT };
+
+    static const char* name(int i) {
+        static const char* names[COUNT] = { "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses" };
+        return names[i];
+    }
+
+    PerfCounters() {
+        for (int& f : fd) f = -1;
+#ifdef __linux__
+        const uint32_t types[COUNT] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+        const uint64_t configs[COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (int i = 0; i < COUNT; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof attr);
+            attr.size = sizeof attr;
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_kernel = 1; // allowed at the default perf_event_paranoid level
+            attr.exclude_hv = 1;
+            fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd[i] >= 0) {
+                if (leader < 0) leader = fd[i];
+                order[members++] = i;
+            }
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int f : fd) if (f >= 0) close(f);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool any() const { return members > 0; }
+    bool available(int i) const { return fd[i] >= 0; }
+
+    // Running totals since the counters were opened
+    void read(uint64_t out[COUNT]) const {
+        for (int i = 0; i < COUNT; ++i) out[i] = 0;
+#ifdef __linux__
+        uint64_t buf[1 + COUNT];
+        if (leader < 0 || ::read(leader, buf, sizeof buf) < (ssize_t)sizeof(uint64_t)) return;
+        for (uint64_t k = 0; k < buf[0] && k < (uint64_t)members; ++k) out[order[k]] = buf[1 + k];
+#else
+        (void)out;
+#endif
+    }
+
+private:
+    int fd[COUNT];
+    int leader = -1;
+    int order[COUNT] = {}; // group read position -> counter
+    int members = 0;
+};
+
+// Wall time, heap allocations and hardware counters per main-loop phase. A phase
+// runs from the previous mark (or beginFrame) to mark(name); phases are matched by
+// name, so ones that only run in some frames (engine steps) still line up. The
+// counters belong to the thread that created the profiler: work a parallelFor hands
+// to pool threads shows up in wall time and allocations but not in the counters.
+class PhaseProfiler {
+public:
+    struct Stats {
+        const char* name;
+        long frames;            // frames in the window that ran this phase
+        double ms, allocations, bytes;
+        double counters[PerfCounters::COUNT]; // per frame that ran the phase
+    };
+
+    void beginFrame() {
+        sample(last);
+        ++frames;
+    }
+
+    void mark(const char* name) {
+        Sample now;
+        sample(now);
+        size_t i = 0;
+        while (i < phases.size() && std::strcmp(phases[i].name, name) != 0) ++i;
+        if (i == phases.size()) phases.push_back(Accum{name});
+        Accum& p = phases[i];
+        ++p.frames;
+        p.ns += now.ns - last.ns;
+        p.allocations += now.allocations - last.allocations;
+        p.bytes += now.bytes - last.bytes;
+        for (int c = 0; c < PerfCounters::COUNT; ++c) p.counters[c] += now.counters[c] - last.counters[c];
+        last = now;
+    }
+
+    long frameCount() const { return frames; }
+    const PerfCounters& counters() const { return perf; }
+
+    // Averages over the frames since the last publish, then starts a new window
+    const std::vector<Stats>& publish() {
+        published.clear();
+        for (auto& p : phases) {
+            if (p.frames == 0) continue;
+            Stats st{p.name, p.frames, 1e-6 * p.ns / p.frames, (double)p.allocations / p.frames, (double)p.bytes / p.frames, {}};
+            for (int c = 0; c < PerfCounters::COUNT; ++c) st.counters[c] = (double)p.counters[c] / p.frames;
+            published.push_back(st);
+            p = Accum{p.name};
+        }
+        windowFrames = frames;
+        frames = 0;
+        return published;
+    }
+
+    const std::vector<Stats>& latest() const { return published; }
+
+    void report(std::ostream& out) const {
+        out << "Per frame over " << windowFrames << " frames:\n";
+        for (const auto& st : published) {
+            char line[160];
+            int n = std::snprintf(line, sizeof line, "  %-12s %7.3f ms %6.1f allocs %8.0f B", st.name, st.ms, st.allocations, st.bytes);
+            if (perf.available(PerfCounters::Cycles) && perf.available(PerfCounters::Instructions) && st.counters[PerfCounters::Cycles] > 0)
+                n += std::snprintf(line + n, sizeof line - n, "  IPC %.2f", st.counters[PerfCounters::Instructions] / st.counters[PerfCounters::Cycles]);
+            for (int c = PerfCounters::L1Misses; c < PerfCounters::COUNT; ++c)
+                if (perf.available(c)) n += std::snprintf(line + n, sizeof line - n, "  %s %.0f", PerfCounters::name(c), st.counters[c]);
+            out << line << "\n";
+        }
+        if (!perf.any()) out << "  (hardware counters unavailable)\n";
+    }
+
+    bool writeJson(const std::string& path) const {
+        std::ofstream f(path);
+        if (!f) return false;
+        f << "{\n  \"frames\": " << windowFrames << ",\n  \"perf_counters\": " << (perf.any() ? "true" : "false")
+          << ",\n  \"phases\": [";
+        for (size_t i = 0; i < published.size(); ++i) {
+            const Stats& st = published[i];
+            f << (i ? "," : "") << "\n    {\"name\": \"" << st.name << "\", \"frames\": " << st.frames
+              << ", \"ms\": " << st.ms << ", \"allocations\": " << st.allocations << ", \"bytes\": " << st.bytes;
+            for (int c = 0; c < PerfCounters::COUNT; ++c) {
+                f << ", \"" << PerfCounters::name(c) << "\": ";
+                if (perf.available(c)) f << st.counters[c]; else f << "null";
+            }
+            f << "}";
+        }
+        f << "\n  ]\n}\n";
+        return (bool)f;
+    }
+
+private:
+    struct Sample {
+        int64_t ns = 0;
+        uint64_t allocations = 0, bytes = 0;
+        uint64_t counters[PerfCounters::COUNT] = {};
+    };
+    struct Accum {
+        const char* name;
+        long frames = 0;
+        int64_t ns = 0;
+        uint64_t allocations = 0, bytes = 0;
+        uint64_t counters[PerfCounters::COUNT] = {};
+    };
+
+    void sample(Sample& s) const {
+        s.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        s.allocations = heapAllocations.load(std::memory_order_relaxed);
+        s.bytes = heapBytes.load(std::memory_order_relaxed);
+        perf.read(s.counters);
+    }
+
+    PerfCounters perf;
+    std::vector<Accum> phases;
+    std::vector<Stats> published;
+    Sample last;
+    long frames = 0, windowFrames = 0;
+};
+
+// Transient per-frame storage: a bump allocator over a fixed buffer, rewound at the
+// top of every frame. Anything that outgrows it falls through to the heap, where the
+// allocation counter sees it.
+class FrameArena {
+public:
+    explicit FrameArena(size_t bytes) : buffer(bytes), resource(buffer.data(), buffer.size()) {}
+    std::pmr::memory_resource* get() { return &resource; }
+    void reset() { resource.release(); }
+
+private:
+    std::vector<std::byte> buffer;
+    std::pmr::monotonic_buffer_resource resource;
+};
+
+// Small persistent thread pool. parallelFor splits [0, n) into chunks of `grain`
+// and the calling thread helps until all chunks are done. Nested calls (or a
+// second caller while a job is running) just run inline, so it never deadlocks.
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned threads = std::max(1u, std::thread::hardware_concurrency())) {
+        for (unsigned i = 1; i < threads; ++i) workers.emplace_back([this]{ workerLoop(); });
+    }
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lk(m);
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto& w : workers) w.join();
+    }
+    unsigned size() const { return (unsigned)workers.size() + 1; }
+
+    void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+        if (n == 0) return;
+        grain = std::max<size_t>(1, grain);
+        std::unique_lock<std::mutex> submit(submitMutex, std::try_to_lock);
+        if (workers.empty() || n <= grain || insideJob() || !submit.owns_lock()) {
+            fn(0, n);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(m);
+            job = &fn;
+            jobSize = n;
+            jobGrain = grain;
+            nextChunk = 0;
+            busyWorkers = workers.size();
+            ++generation;
+        }
+        cv.notify_all();
+        runChunks();
+        std::unique_lock<std::mutex> lk(m);
+        doneCv.wait(lk, [&]{ return busyWorkers == 0; });
+        job = nullptr;
+    }
+
+private:
+    static bool& insideJob() { static thread_local bool inside = false; return inside; }
+
+    void runChunks() {
+        insideJob() = true;
+        for (;;) {
+            size_t b = nextChunk.fetch_add(jobGrain);
+            if (b >= jobSize) break;
+            (*job)(b, std::min(jobSize, b + jobGrain));
+        }
+        insideJob() = false;
+    }
+
+    void workerLoop() {
+        size_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk(m);
+                cv.wait(lk, [&]{ return stop || generation != seen; });
+                if (stop) return;
+                seen = generation;
+            }
+            runChunks();
+            std::lock_guard<std::mutex> lk(m);
+            if (--busyWorkers == 0) doneCv.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex m, submitMutex;
+    std::condition_variable cv, doneCv;
+    const std::function<void(size_t, size_t)>* job = nullptr;
+    size_t jobSize = 0, jobGrain = 1, busyWorkers = 0, generation = 0;
+    std::atomic<size_t> nextChunk{0};
+    bool stop = false;
+};
+
+WorkerPool& workerPool() {
+    static WorkerPool pool;
+    return pool;
+}
+
+// ---- System scheduler ----
+
+// Scene state as components: the atom components of AtomWorld and the
+// engine-owned state that per-frame systems declare they read or write.
+struct Components {
+    enum : uint32_t {
+        Position  = 1u << 0,  // Position
+        Active    = 1u << 1,  // Activity
+        Electrons = 1u << 2,  // Shells
+        Flash     = 1u << 3,  // Glow
+        Timelines = 1u << 4,  // suspended timeline coroutines
+        Links     = 1u << 5,
+        Version   = 1u << 6,  // sceneVersion
+        Spectrum  = 1u << 7,  // SpectrumEngine counts
+        Pulses    = 1u << 8,  // pi pulses queued for the Bloch engine
+        Photons   = 1u << 9,
+        Kinetics  = 1u << 10,
+        Spins     = 1u << 11,
+        Bloch     = 1u << 12,
+        Thermal   = 1u << 13,
+        Structure = 1u << 14,
+        Wave      = 1u << 15,
+        Status    = 1u << 16, // status line, Hartree-Fock job and cache
+        Feed      = 1u << 17, // shared-memory publisher and its link journal
+        Stats     = 1u << 18, // SceneStats counters
+    };
+};
+
+// Runs the enabled systems once per frame. Two systems conflict when one writes a
+// component the other reads or writes; conflicting systems keep their registration
+// order and everything else in a wave runs concurrently on the worker pool. The
+// waves are recomputed only when the set of enabled systems (at most 64) changes.
+class SystemScheduler {
+public:
+    using Mask = uint32_t;
+
+    void add(const char* name, Mask reads, Mask writes, std::function<bool()> enabled, std::function<void()> run) {
+        systems.push_back({name, reads, writes, std::move(enabled), std::move(run)});
+        enabledSet = ~0ull; // force a replan
+    }
+
+    // Marks one profiler phase per wave, named after its systems
+    void run(PhaseProfiler* profiler = nullptr) {
+        uint64_t on = 0;
+        for (size_t i = 0; i < systems.size(); ++i)
+            if (!systems[i].enabled || systems[i].enabled()) on |= 1ull << i;
+        if (on != enabledSet) plan(on);
+        for (const Wave& w : waves) {
+            if (w.members.size() == 1) {
+                systems[w.members[0]].run(); // on this thread, so its own parallelFor still fans out
+            } else {
+                workerPool().parallelFor(w.members.size(), 1, [&](size_t b, size_t e){
+                    for (size_t i = b; i < e; ++i) systems[w.members[i]].run();
+                });
+            }
+            if (profiler) profiler->mark(w.label);
+        }
+    }
+
+    size_t waveCount() const { return waves.size(); }
+
+private:
+    struct System {
+        const char* name;
+        Mask reads, writes;
+        std::function<bool()> enabled; // empty: always on
+        std::function<void()> run;
+    };
+    struct Wave {
+        std::vector<size_t> members;
+        const char* label;
+    };
+
+    static bool conflict(const System& a, const System& b) {
+        return (a.writes & (b.reads | b.writes)) || (b.writes & a.reads);
+    }
+
+    void plan(uint64_t on) {
+        enabledSet = on;
+        waves.clear();
+        std::vector<size_t> level(systems.size(), 0);
+        for (size_t j = 0; j < systems.size(); ++j) {
+            if (!(on >> j & 1)) continue;
+            size_t l = 0;
+            for (size_t i = 0; i < j; ++i)
+                if ((on >> i & 1) && conflict(systems[i], systems[j])) l = std::max(l, level[i] + 1);
+            level[j] = l;
+            if (waves.size() <= l) waves.resize(l + 1);
+            waves[l].members.push_back(j);
+        }
+        for (Wave& w : waves) {
+            std::string label;
+            for (size_t k = 0; k < w.members.size(); ++k) label += (k ? " | " : "") + std::string(systems[w.members[k]].name);
+            w.label = labels.insert(label).first->c_str(); // interned: the profiler keeps the pointer
+        }
+    }
+
+    std::vector<System> systems;
+    std::vector<Wave> waves;
+    std::set<std::string> labels;
+    uint64_t enabledSet = ~0ull;
+};
+
+// ---- Timelines ----
+
+// A scripted sequence as a C++20 coroutine: a function returning Timeline that
+// suspends on `co_await timelines.after(seconds)` or `co_await timelines.until(pred)`.
+// Timelines start suspended; TimelineScheduler::spawn takes ownership and tick()
+// resumes them from the simulation loop, so no script has a thread and a suspended
+// one costs only its coroutine frame.
+class Timeline {
+public:
+    struct promise_type {
+        size_t slot = 0; // index in TimelineScheduler::live
+        std::exception_ptr error;
+
+        Timeline get_return_object() { return Timeline(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Timeline(Timeline&& o) noexcept : h(std::exchange(o.h, nullptr)) {}
+    Timeline(const Timeline&) = delete;
+    Timeline& operator=(const Timeline&) = delete;
+    ~Timeline() { if (h) h.destroy(); }
+
+    Handle release() { return std::exchange(h, nullptr); }
+
+private:
+    explicit Timeline(Handle h) : h(h) {}
+    Handle h;
+};
+
+// Time waits sit in a min-heap, so a tick costs O(due * log n) for them however many
+// timelines are asleep. Condition waits have no wake time and are re-checked every
+// tick, so they cost one predicate call per waiting timeline per tick.
+class TimelineScheduler {
+public:
+    struct After {
+        TimelineScheduler* s;
+        double seconds;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(Timeline::Handle h) { s->sleep(h, s->now + std::max(0.0, seconds)); }
+        void await_resume() const noexcept {}
+    };
+    struct Until {
+        TimelineScheduler* s;
+        std::function<bool()> pred; // lives in the suspended frame; the scheduler only points at it
+        bool await_ready() { return pred(); }
+        void await_suspend(Timeline::Handle h) { s->waiters.push_back({&pred, h}); }
+        void await_resume() const noexcept {}
+    };
+
+    ~TimelineScheduler() { clear(); }
+
+    After after(double seconds) { return After{this, seconds}; }
+    Until until(std::function<bool()> pred) { return Until{this, std::move(pred)}; }
+
+    // Starts on the next tick
+    void spawn(Timeline t) {
+        Timeline::Handle h = t.release();
+        h.promise().slot = live.size();
+        live.push_back(h);
+        sleep(h, now);
+    }
+
+    // Resumes every timeline due at `time` (seconds on the sim clock). Timelines that
+    // wait or spawn during the tick are picked up on the next one, so a loop of
+    // after(0) can't stall the frame.
+    void tick(double time) {
+        now = time;
+        uint64_t limit = nextSeq;
+        while (!sleepers.empty() && sleepers.top().wake <= now && sleepers.top().seq < limit) {
+            Timeline::Handle h = sleepers.top().h;
+            sleepers.pop();
+            resume(h);
+        }
+        for (size_t i = 0, n = waiters.size(); i < n;) {
+            if (!(*waiters[i].pred)()) { ++i; continue; }
+            Timeline::Handle h = waiters[i].h;
+            waiters[i] = waiters[n - 1];
+            waiters.erase(waiters.begin() + (n - 1)); // keeps waiters added by earlier resumes at the tail
+            --n;
+            resume(h);
+        }
+    }
+
+    void clear() {
+        for (auto h : live) h.destroy();
+        live.clear();
+        waiters.clear();
+        sleepers = {};
+    }
+
+    size_t size() const { return live.size(); }
+    double time() const { return now; }
+
+    // Message of the last timeline that ended with an exception, cleared on read
+    std::string takeError() { return std::exchange(lastError, std::string()); }
+
+private:
+    struct Sleeper {
+        double wake;
+        uint64_t seq; // FIFO among equal wake times
+        Timeline::Handle h;
+        bool operator>(const Sleeper& o) const { return wake != o.wake ? wake > o.wake : seq > o.seq; }
+    };
+    struct Waiter {
+        const std::function<bool()>* pred;
+        Timeline::Handle h;
+    };
+
+    void sleep(Timeline::Handle h, double wake) { sleepers.push({wake, nextSeq++, h}); }
+
+    void resume(Timeline::Handle h) {
+        h.resume();
+        if (!h.done()) return;
+        if (auto error = h.promise().error) {
+            try { std::rethrow_exception(error); }
+            catch (const std::exception& e) { lastError = e.what(); }
+            catch (...) { lastError = "unknown error"; }
+        }
+        size_t slot = h.promise().slot;
+        live[slot] = live.back();
+        live[slot].promise().slot = slot;
+        live.pop_back();
+        h.destroy();
+    }
+
+    std::priority_queue<Sleeper, std::vector<Sleeper>, std::greater<Sleeper>> sleepers;
+    std::vector<Waiter> waiters;
+    std::vector<Timeline::Handle> live; // owned frames, destroyed when done or on clear()
+    uint64_t nextSeq = 0;
+    double now = 0.0;
+    std::string lastError;
+};
+
+// ---- Orbitals ----
+
+struct Subshell { int n; int l; int electrons; };
+
+// Ground-state configuration using the Madelung (aufbau) filling order.
+std::vector<Subshell> electronConfiguration(int atomicNumber) {
+    static const int order[][2] = {
+        {1,0},{2,0},{2,1},{3,0},{3,1},{4,0},{3,2},{4,1},{5,0},{4,2},
+        {5,1},{6,0},{4,3},{5,2},{6,1},{7,0},{5,3},{6,2},{7,1}
+    };
+    std::vector<Subshell> cfg;
+    int remaining = atomicNumber;
+    for (const auto& o : order) {
+        if (remaining <= 0) break;
+        int inShell = std::min(remaining, 2 * (2 * o[1] + 1));
+        cfg.push_back({o[0], o[1], inShell});
+        remaining -= inShell;
+    }
+    return cfg;
+}
+
+// Slater's rules: effective nuclear charge felt by one electron in subshell (n, l).
+float slaterZeff(int atomicNumber, const std::vector<Subshell>& cfg, int n, int l) {
+    float shielding = 0.f;
+    for (const auto& s : cfg) {
+        int others = s.electrons - ((s.n == n && s.l == l) ? 1 : 0);
+        if (others <= 0) continue;
+        bool sameGroup = (l <= 1) ? (s.n == n && s.l <= 1) : (s.n == n && s.l == l);
+        if (sameGroup) {
+            shielding += others * (n == 1 ? 0.30f : 0.35f);
+        } else if (l <= 1) {
+            if (s.n == n - 1) shielding += others * 0.85f;
+            else if (s.n < n - 1) shielding += others * 1.00f;
+        } else if (s.n < n || (s.n == n && s.l < l)) {
+            shielding += others; // d/f: every group to the left shields fully
+        }
+    }
+    return std::max(1.f, atomicNumber - shielding);
+}
+
+// Zeff seen by the outermost electron, i.e. what a valence electron feels.
+float valenceZeff(int atomicNumber) {
+    auto cfg = electronConfiguration(atomicNumber);
+    return slaterZeff(atomicNumber, cfg, cfg.back().n, cfg.back().l);
+}
+
+struct OrbitalOccupancy { int n, l, m, electrons; };
+
+// Splits each subshell over its m orbitals following Hund's rule (singly first,
+// then paired). m = 0, +1, -1, +2, ... so partial shells favour orbitals that
+// show up in the xz slice.
+std::vector<OrbitalOccupancy> occupiedOrbitals(int atomicNumber) {
+    std::vector<OrbitalOccupancy> out;
+    for (const auto& s : electronConfiguration(atomicNumber)) {
+        int count = 2 * s.l + 1;
+        std::vector<int> ms;
+        ms.push_back(0);
+        for (int k = 1; k <= s.l; ++k) { ms.push_back(k); ms.push_back(-k); }
+        for (int i = 0; i < count; ++i) {
+            int e = (s.electrons > i ? 1 : 0) + (s.electrons > count + i ? 1 : 0);
+            if (e > 0) out.push_back({s.n, s.l, ms[i], e});
+        }
+    }
+    return out;
+}
+
+// Generalized Laguerre polynomial L_k^a(x) by upward recurrence.
+double laguerre(int k, double a, double x) {
+    if (k == 0) return 1.0;
+    double l0 = 1.0, l1 = 1.0 + a - x;
+    for (int i = 1; i < k; ++i) {
+        double l2 = ((2 * i + 1 + a - x) * l1 - (i + a) * l0) / (i + 1);
+        l0 = l1;
+        l1 = l2;
+    }
+    return l1;
+}
+
+// Real solid harmonics r^l * Y_lm (unnormalized, l <= 3).
+double solidHarmonic(int l, int m, double x, double y, double z) {
+    double r2 = x*x + y*y + z*z;
+    switch (l) {
+    case 0: return 1.0;
+    case 1: return m < 0 ? y : (m == 0 ? z : x);
+    case 2:
+        switch (m) {
+        case -2: return x*y;
+        case -1: return y*z;
+        case 0:  return 3*z*z - r2;
+        case 1:  return x*z;
+        default: return x*x - y*y;
+        }
+    default:
+        switch (m) {
+        case -3: return (3*x*x - y*y) * y;
+        case -2: return x*y*z;
+        case -1: return y * (5*z*z - r2);
+        case 0:  return z * (5*z*z - 3*r2);
+        case 1:  return x * (5*z*z - r2);
+        case 2:  return z * (x*x - y*y);
+        default: return x * (x*x - 3*y*y);
+        }
+    }
+}
+
+static const unsigned CLOUD_TEX = 96;        // texture resolution of one orbital slice
+static const float PIXELS_PER_BOHR = 16.f;
+
+// Half width of the slice in bohr: generous enough for the outer lobe.
+float orbitalExtentBohr(int n, float zeff) {
+    return (n * n + 2.f * n) / zeff;
+}
+
+// |psi_nlm|^2 of a hydrogenic orbital with charge zeff, sampled on the xz plane
+// (y = 0). Written as white RGBA with the density (sqrt for contrast) in alpha.
+std::vector<sf::Uint8> orbitalDensityImage(int n, int l, int m, float zeff) {
+    std::vector<double> dens(CLOUD_TEX * CLOUD_TEX);
+    double extent = orbitalExtentBohr(n, zeff);
+    double peak = 0.0;
+    for (unsigned j = 0; j < CLOUD_TEX; ++j) {
+        for (unsigned i = 0; i < CLOUD_TEX; ++i) {
+            double x = ((i + 0.5) / CLOUD_TEX * 2.0 - 1.0) * extent;
+            double z = (1.0 - (j + 0.5) / CLOUD_TEX * 2.0) * extent;
+            double r = std::sqrt(x*x + z*z);
+            double rho = 2.0 * zeff * r / n;
+            double psi = std::exp(-rho / 2) * laguerre(n - l - 1, 2 * l + 1, rho) * solidHarmonic(l, m, x, 0.0, z);
+            dens[j * CLOUD_TEX + i] = psi * psi;
+            peak = std::max(peak, psi * psi);
+        }
+    }
+    std::vector<sf::Uint8> px(CLOUD_TEX * CLOUD_TEX * 4, 255);
+    for (size_t k = 0; k < dens.size(); ++k) {
+        px[k * 4 + 3] = peak > 0 ? (sf::Uint8)(255.0 * std::sqrt(dens[k] / peak)) : 0;
+    }
+    return px;
+}
+
+uint32_t orbitalKey(int elementIndex, int n, int l, int m) {
+    return (uint32_t)elementIndex << 12 | (uint32_t)n << 8 | (uint32_t)l << 4 | (uint32_t)(m + 8);
+}
+
+// LRU cache of orbital slice textures keyed by (element, n, l, m). Missing
+// images are computed together on the worker pool; the upload to GL happens
+// on the calling (render) thread.
+class OrbitalCloudCache {
+public:
+    struct Entry {
+        sf::Texture texture;
+        float halfExtent = 0.f; // pixels
+        bool empty = false;     // orbital has a node across the whole slice
+    };
+
+    explicit OrbitalCloudCache(size_t capacity) : capacity(capacity) {}
+
+    // Per-frame scratch for drawOrbitalClouds, kept so a steady frame allocates nothing
+    std::vector<std::vector<sf::Vector2f>> drawByElement; // atom positions per element
+    std::vector<uint32_t> drawKeys;
+    sf::VertexArray drawQuads{sf::Quads};
+
+    void require(const std::vector<uint32_t>& keys) {
+        missing.clear();
+        for (uint32_t k : keys) {
+            if (!index.count(k) && std::find(missing.begin(), missing.end(), k) == missing.end()) missing.push_back(k);
+        }
+        if (missing.empty()) return;
+
+        std::vector<std::vector<sf::Uint8>> images(missing.size());
+        std::vector<float> extents(missing.size());
+        workerPool().parallelFor(missing.size(), 1, [&](size_t b, size_t e){
+            for (size_t i = b; i < e; ++i) {
+                uint32_t k = missing[i];
+                int el = (int)(k >> 12), n = (int)(k >> 8 & 15), l = (int)(k >> 4 & 15), m = (int)(k & 15) - 8;
+                int z = ELEMENTS[el].atomicNumber;
+                float zeff = slaterZeff(z, electronConfiguration(z), n, l);
+                images[i] = orbitalDensityImage(n, l, m, zeff);
+                extents[i] = orbitalExtentBohr(n, zeff) * PIXELS_PER_BOHR;
+            }
+        });
+
+        for (size_t i = 0; i < missing.size(); ++i) {
+            lru.emplace_front();
+            Entry& entry = lru.front().second;
+            lru.front().first = missing[i];
+            entry.texture.create(CLOUD_TEX, CLOUD_TEX);
+            entry.texture.update(images[i].data());
+            entry.texture.setSmooth(true);
+            entry.halfExtent = extents[i];
+            entry.empty = true;
+            for (size_t k = 3; k < images[i].size(); k += 4) if (images[i][k] > 0) { entry.empty = false; break; }
+            index[missing[i]] = lru.begin();
+        }
+        while (lru.size() > capacity) {
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+    }
+
+    const Entry* find(uint32_t key) {
+        auto it = index.find(key);
+        if (it == index.end()) return nullptr;
+        lru.splice(lru.begin(), lru, it->second);
+        return &it->second->second;
+    }
+
+private:
+    size_t capacity;
+    std::vector<uint32_t> missing;
+    std::list<std::pair<uint32_t, Entry>> lru;
+    std::unordered_map<uint32_t, std::list<std::pair<uint32_t, Entry>>::iterator> index;
+};
+
+// Draws the orbital clouds of every atom: one textured quad per atom and
+// orbital, batched so each distinct (element, n, l, m) is a single draw call.
+void drawOrbitalClouds(sf::RenderWindow& window, const AtomStore& atoms, OrbitalCloudCache& cache) {
+    static std::vector<std::vector<OrbitalOccupancy>> orbitalsByElement;
+    if (orbitalsByElement.empty()) {
+        for (const auto& el : ELEMENTS) orbitalsByElement.push_back(occupiedOrbitals(el.atomicNumber));
+    }
+
+    auto& byElement = cache.drawByElement;
+    byElement.resize(ELEMENTS.size());
+    for (auto& list : byElement) list.clear();
+    for (const auto& a : atoms) byElement[a.elementIndex].push_back(a.pos);
+
+    auto& keys = cache.drawKeys;
+    keys.clear();
+    for (size_t el = 0; el < ELEMENTS.size(); ++el) {
+        if (byElement[el].empty()) continue;
+        for (const auto& o : orbitalsByElement[el]) keys.push_back(orbitalKey((int)el, o.n, o.l, o.m));
+    }
+    cache.require(keys);
+
+    sf::VertexArray& quads = cache.drawQuads;
+    for (size_t el = 0; el < ELEMENTS.size(); ++el) {
+        if (byElement[el].empty()) continue;
+        const sf::Color& c = ELEMENTS[el].color;
+        for (const auto& o : orbitalsByElement[el]) {
+            const OrbitalCloudCache::Entry* entry = cache.find(orbitalKey((int)el, o.n, o.l, o.m));
+            if (!entry || entry->empty) continue;
+            float h = entry->halfExtent;
+            float t = (float)CLOUD_TEX;
+            sf::Color tint(c.r, c.g, c.b, (sf::Uint8)(90 * o.electrons));
+            quads.clear();
+            for (sf::Vector2f p : byElement[el]) {
+                quads.append(sf::Vertex({p.x - h, p.y - h}, tint, {0.f, 0.f}));
+                quads.append(sf::Vertex({p.x + h, p.y - h}, tint, {t, 0.f}));
+                quads.append(sf::Vertex({p.x + h, p.y + h}, tint, {t, t}));
+                quads.append(sf::Vertex({p.x - h, p.y + h}, tint, {0.f, t}));
+            }
+            window.draw(quads, sf::RenderStates(&entry->texture));
+        }
+    }
+}
+
+// ---- Radial Schrodinger solver ----
+
+// Thomas-Fermi screened charge (Sommerfeld/Tietz fit of the TF function) with
+// Latter's tail correction: far out an electron sees the +1 ion it left behind.
+double centralFieldCharge(int z, double r) {
+    double b = 0.8853 / std::cbrt((double)z);
+    double s = 1.0 + 0.53625 * r / b;
+    return std::max(z / (s * s), 1.0);
+}
+
+struct RadialLevel {
+    int n, l, electrons;
+    float energy; // hartree
+    float rMean;  // <r> in bohr
+    bool bound;
+};
+
+// Log grid x = ln r. With u(r) = sqrt(r) y(x) the radial equation becomes
+// y'' = [2 r^2 (V - E) + (l + 1/2)^2] y, which Numerov integrates on uniform x.
+static const double RADIAL_X0 = -13.8, RADIAL_X1 = 4.4, RADIAL_DX = 0.004; // r from 1e-6 to ~80 bohr
+
+// Outward Numerov integration at energy e; returns the number of nodes. The
+// solution is rescaled on the fly so the classically forbidden tail stays finite,
+// and integration stops once the step gets too coarse for the decay rate (deep
+// in the forbidden region, where Numerov would go unstable and nothing can
+// change the node count anyway).
+int numerovOutward(const std::vector<double>& r, const std::vector<double>& r2V2, int l, double e, std::vector<double>* yOut) {
+    const double h12 = RADIAL_DX * RADIAL_DX / 12.0, ll = (l + 0.5) * (l + 0.5);
+    size_t count = r.size();
+    auto g = [&](size_t i){ return r2V2[i] - 2.0 * r[i] * r[i] * e + ll; };
+    std::vector<double> local;
+    std::vector<double>& y = yOut ? *yOut : local;
+    y.assign(count, 0.0);
+    y[0] = std::pow(r[0], l + 0.5);
+    y[1] = std::pow(r[1], l + 0.5);
+    int nodes = 0;
+    double gPrev = g(0), gCur = g(1);
+    for (size_t i = 1; i + 1 < count; ++i) {
+        double gNext = g(i + 1);
+        if (h12 * gNext > 0.3) break;
+        y[i + 1] = (2.0 * (1.0 + 5.0 * h12 * gCur) * y[i] - (1.0 - h12 * gPrev) * y[i - 1]) / (1.0 - h12 * gNext);
+        if ((y[i + 1] < 0) != (y[i] < 0)) ++nodes;
+        if (std::abs(y[i + 1]) > 1e150) {
+            for (size_t k = 0; k <= i + 1; ++k) y[k] *= 1e-150;
+        }
+        gPrev = gCur;
+        gCur = gNext;
+    }
+    return nodes;
+}
+
+// Bisects on the node count: the n-l-1 -> n-l node transition is the eigenvalue.
+RadialLevel solveRadialLevel(int z, int n, int l) {
+    std::vector<double> r, r2V2;
+    for (double x = RADIAL_X0; x <= RADIAL_X1; x += RADIAL_DX) {
+        double rr = std::exp(x);
+        r.push_back(rr);
+        r2V2.push_back(-2.0 * rr * centralFieldCharge(z, rr));
+    }
+    int wantNodes = n - l - 1;
+    double lo = -0.5 * z * z - 1.0, hi = -1e-6;
+    RadialLevel level{n, l, 0, 0.f, 0.f, false};
+    if (numerovOutward(r, r2V2, l, hi, nullptr) <= wantNodes) return level;
+    for (int it = 0; it < 200 && hi - lo > 1e-12 * std::abs(lo); ++it) {
+        double mid = 0.5 * (lo + hi);
+        if (numerovOutward(r, r2V2, l, mid, nullptr) > wantNodes) hi = mid;
+        else lo = mid;
+    }
+
+    std::vector<double> y;
+    numerovOutward(r, r2V2, l, lo, &y);
+    // Cut the diverging tail at the first minimum of |u| past the outer turning point
+    size_t turn = 0;
+    for (size_t i = 0; i < r.size(); ++i) {
+        if (r2V2[i] - 2.0 * r[i] * r[i] * lo + l * (l + 1.0) < 0) turn = i;
+    }
+    for (size_t i = turn + 1; i < r.size(); ++i) {
+        if (std::abs(y[i]) * std::sqrt(r[i]) > std::abs(y[i - 1]) * std::sqrt(r[i - 1])) {
+            std::fill(y.begin() + i, y.end(), 0.0);
+            break;
+        }
+    }
+    double norm = 0.0, moment = 0.0;
+    for (size_t i = 0; i < r.size(); ++i) {
+        double w = r[i] * r[i] * y[i] * y[i];
+        norm += w;
+        moment += w * r[i];
+    }
+    level.energy = (float)lo;
+    level.rMean = norm > 0 ? (float)(moment / norm) : 0.f;
+    level.bound = true;
+    return level;
+}
+
+// Occupied levels per atomic number, solved for the whole element table in
+// parallel on first use. Other atomic numbers are solved when first asked for.
+const std::vector<RadialLevel>& radialLevels(int atomicNumber) {
+    static std::mutex m;
+    static std::unordered_map<int, std::vector<RadialLevel>> cache;
+    auto solveAll = [](int z){
+        std::vector<RadialLevel> out;
+        for (const auto& s : electronConfiguration(z)) {
+            RadialLevel lv = solveRadialLevel(z, s.n, s.l);
+            lv.electrons = s.electrons;
+            out.push_back(lv);
+        }
+        return out;
+    };
+    std::lock_guard<std::mutex> lk(m);
+    if (cache.empty()) {
+        std::vector<std::vector<RadialLevel>> table(ELEMENTS.size());
+        workerPool().parallelFor(ELEMENTS.size(), 1, [&](size_t b, size_t e){
+            for (size_t i = b; i < e; ++i) table[i] = solveAll(ELEMENTS[i].atomicNumber);
+        });
+        for (size_t i = 0; i < ELEMENTS.size(); ++i) cache[ELEMENTS[i].atomicNumber] = std::move(table[i]);
+    }
+    auto it = cache.find(atomicNumber);
+    if (it == cache.end()) it = cache.emplace(atomicNumber, solveAll(atomicNumber)).first;
+    return it->second;
+}
+
+std::vector<Electron> makeElectronsForElement(int atomicNumber) {
+    // One ring per occupied subshell. The ring radius follows <r> from the
+    // radial solver (sqrt-compressed so 1s and valence shells both fit) and the
+    // angular speed follows the Bohr-like rate sqrt(2|E|)/<r>, log-compressed.
+    std::vector<Electron> e;
+    int remaining = std::min(atomicNumber, 24); // cap for rendering
+    std::srand((unsigned)std::time(nullptr));
+
+    const auto& levels = radialLevels(atomicNumber);
+    for (size_t s = 0; s < levels.size() && remaining > 0; ++s) {
+        const RadialLevel& lv = levels[s];
+        int inShell = std::min(remaining, lv.electrons);
+        float radius = 22.f + 24.5f * std::sqrt(std::max(lv.rMean, 0.f));
+        float omega = std::sqrt(2.f * std::abs(lv.energy)) / std::max(lv.rMean, 1e-3f);
+        float speed = (s % 2 == 0 ? 1.f : -1.f) * (0.4f + 0.3f * std::log(1.f + omega));
+        for (int i = 0; i < inShell; ++i) {
+            float angle = (2.f * 3.1415926f * i) / std::max(1, inShell) + 0.7f * s;
+            float v = speed + ((std::rand() % 100) / 100.f - 0.5f) * 0.2f; // slight variance
+            e.push_back({radius, angle, v});
+        }
+        remaining -= inShell;
+    }
+    return e;
+}
+
+// ---- Hartree-Fock (RHF / STO-3G) ----
+
+// STO-3G contractions for a Slater exponent of 1; exponents scale with zeta^2.
+static const double STO3G_1S_EXP[3] = {2.227660584, 0.4057711562, 0.1098175104};
+static const double STO3G_1S_COEF[3] = {0.1543289673, 0.5353281423, 0.4446345422};
+static const double STO3G_2SP_EXP[3] = {0.9942027630, 0.2310313333, 0.07513856000};
+static const double STO3G_2S_COEF[3] = {-0.09996722919, 0.3995128261, 0.7001154689};
+static const double STO3G_2P_COEF[3] = {0.1559162750, 0.6076837186, 0.3919573931};
+static const double STO3G_3SP_EXP[3] = {0.4828540806, 0.1347150629, 0.05272656258};
+static const double STO3G_3S_COEF[3] = {-0.2196203690, 0.2255954336, 0.9003984260};
+static const double STO3G_3P_COEF[3] = {0.01058760429, 0.5951670053, 0.4620010120};
+
+// Standard molecular Slater exponents per shell (1s, 2sp, 3sp) of the STO-3G set.
+std::vector<double> sto3gZetas(int atomicNumber) {
+    switch (atomicNumber) {
+    case 1:  return {1.24};
+    case 2:  return {1.69};
+    case 3:  return {2.69, 0.80};
+    case 4:  return {3.68, 1.15};
+    case 5:  return {4.68, 1.50};
+    case 6:  return {5.67, 1.72};
+    case 7:  return {6.67, 1.95};
+    case 8:  return {7.66, 2.25};
+    case 11: return {10.61, 3.48, 1.75};
+    case 17: return {16.43, 6.26, 2.10};
+    default: return {};
+    }
+}
+
+// Single-bond covalent radius in angstrom, used to turn canvas distances into bond lengths.
+double covalentRadius(int atomicNumber) {
+    switch (atomicNumber) {
+    case 1:  return 0.31;
+    case 2:  return 0.28;
+    case 3:  return 1.28;
+    case 4:  return 0.96;
+    case 5:  return 0.84;
+    case 6:  return 0.76;
+    case 7:  return 0.71;
+    case 8:  return 0.66;
+    case 11: return 1.66;
+    case 17: return 1.02;
+    default: return 1.0;
+    }
+}
+
+static const double BOHR_PER_ANGSTROM = 1.0 / 0.529177;
+static const double PI_D = 3.14159265358979323846;
+
+struct BasisFunction {
+    double center[3];
+    int lmn[3];
+    double exps[3];
+    double coefs[3]; // contraction coefficient times primitive normalization
+};
+
+// Hermite expansion coefficient E_t^{ij} of a 1D Gaussian product (McMurchie-Davidson).
+double hermiteE(int i, int j, int t, double qx, double a, double b) {
+    double p = a + b, q = a * b / p;
+    if (t < 0 || t > i + j) return 0.0;
+    if (i == 0 && j == 0 && t == 0) return std::exp(-q * qx * qx);
+    if (j == 0) {
+        return hermiteE(i - 1, j, t - 1, qx, a, b) / (2 * p) - q * qx / a * hermiteE(i - 1, j, t, qx, a, b)
+             + (t + 1) * hermiteE(i - 1, j, t + 1, qx, a, b);
+    }
+    return hermiteE(i, j - 1, t - 1, qx, a, b) / (2 * p) + q * qx / b * hermiteE(i, j - 1, t, qx, a, b)
+         + (t + 1) * hermiteE(i, j - 1, t + 1, qx, a, b);
+}
+
+// Boys function F_m(T) by its series, used to fill the interpolation table.
+double boysSeries(int m, double t) {
+    double term = 1.0 / (2 * m + 1), sum = term;
+    for (int k = 1; k < 400 && term > 1e-17 * sum; ++k) {
+        term *= 2 * t / (2 * m + 2 * k + 1);
+        sum += term;
+    }
+    return std::exp(-t) * sum;
+}
+
+// Boys function F_m(T) for m = 0..mmax (mmax <= 4). Below T = 30 the top order
+// comes from a 6-term Taylor expansion around the nearest point of a table
+// (dF_m/dT = -F_m+1) and the rest from downward recursion; above it from the
+// asymptotic value and upward recursion.
+void boysFunction(int mmax, double t, double* f) {
+    static const int ORDERS = 11, POINTS = 601;
+    static const double STEP = 0.05;
+    static const std::vector<double> table = []{
+        std::vector<double> tab(ORDERS * POINTS);
+        for (int i = 0; i < POINTS; ++i)
+            for (int m = 0; m < ORDERS; ++m) tab[i * ORDERS + m] = boysSeries(m, i * STEP);
+        return tab;
+    }();
+    if (t > 30.0) {
+        double et = std::exp(-t);
+        f[0] = 0.5 * std::sqrt(PI_D / t);
+        for (int m = 0; m < mmax; ++m) f[m + 1] = ((2 * m + 1) * f[m] - et) / (2 * t);
+        return;
+    }
+    int i = (int)(t / STEP + 0.5);
+    double d = i * STEP - t, dk = 1.0;
+    const double* row = &table[i * ORDERS + mmax];
+    double top = 0.0;
+    for (int k = 0; k < 6; ++k) {
+        top += row[k] * dk;
+        dk *= d / (k + 1);
+    }
+    f[mmax] = top;
+    if (mmax > 0) {
+        double et = std::exp(-t);
+        for (int m = mmax; m > 0; --m) f[m - 1] = (2 * t * f[m] + et) / (2 * m - 1);
+    }
+}
+
+// Hermite Coulomb integrals R_tuv (n = 0) for t + u + v <= L <= 4.
+void hermiteR(int L, double alpha, const double pc[3], double out[5][5][5]) {
+    double f[9];
+    boysFunction(L, alpha * (pc[0]*pc[0] + pc[1]*pc[1] + pc[2]*pc[2]), f);
+    if (L == 0) {
+        out[0][0][0] = f[0];
+        return;
+    }
+    double r[5][5][5][5]; // [n][t][u][v]
+    double scale = 1.0;
+    for (int n = 0; n <= L; ++n) {
+        r[n][0][0][0] = scale * f[n];
+        scale *= -2.0 * alpha;
+    }
+    for (int n = L - 1; n >= 0; --n) {
+        int top = L - n;
+        for (int t = 0; t <= top; ++t) {
+            for (int u = 0; u + t <= top; ++u) {
+                for (int v = 0; v + u + t <= top; ++v) {
+                    if (t + u + v == 0) continue;
+                    double val;
+                    if (t > 0) val = (t > 1 ? (t - 1) * r[n + 1][t - 2][u][v] : 0.0) + pc[0] * r[n + 1][t - 1][u][v];
+                    else if (u > 0) val = (u > 1 ? (u - 1) * r[n + 1][t][u - 2][v] : 0.0) + pc[1] * r[n + 1][t][u - 1][v];
+                    else val = (v > 1 ? (v - 1) * r[n + 1][t][u][v - 2] : 0.0) + pc[2] * r[n + 1][t][u][v - 1];
+                    r[n][t][u][v] = val;
+                }
+            }
+        }
+    }
+    for (int t = 0; t <= L; ++t)
+        for (int u = 0; u + t <= L; ++u)
+            for (int v = 0; v + u + t <= L; ++v)
+                out[t][u][v] = r[0][t][u][v];
+}
+
+// Product of two primitives, with the Hermite coefficients for each axis precomputed.
+struct PrimitivePair {
+    double p, k;      // exponent sum, coefficient product
+    double center[3];
+    double e[3][3];   // [axis][t]
+    double bound;     // |k| * max |E| per axis, for screening primitive quartets
+};
+
+struct BasisPair {
+    int l[3];         // summed angular momentum per axis
+    std::vector<PrimitivePair> prims;
+};
+
+BasisPair makeBasisPair(const BasisFunction& a, const BasisFunction& b) {
+    BasisPair bp;
+    for (int x = 0; x < 3; ++x) bp.l[x] = a.lmn[x] + b.lmn[x];
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            PrimitivePair pp;
+            double ea = a.exps[i], eb = b.exps[j];
+            pp.p = ea + eb;
+            pp.k = a.coefs[i] * b.coefs[j];
+            for (int x = 0; x < 3; ++x) {
+                pp.center[x] = (ea * a.center[x] + eb * b.center[x]) / pp.p;
+                for (int t = 0; t < 3; ++t) pp.e[x][t] = hermiteE(a.lmn[x], b.lmn[x], t, a.center[x] - b.center[x], ea, eb);
+            }
+            pp.bound = std::abs(pp.k);
+            for (int x = 0; x < 3; ++x) pp.bound *= std::max({std::abs(pp.e[x][0]), std::abs(pp.e[x][1]), std::abs(pp.e[x][2])});
+            bp.prims.push_back(pp);
+        }
+    }
+    return bp;
+}
+
+double overlapIntegral(const BasisPair& ab) {
+    double s = 0.0;
+    for (const auto& pp : ab.prims) s += pp.k * std::pow(PI_D / pp.p, 1.5) * pp.e[0][0] * pp.e[1][0] * pp.e[2][0];
+    return s;
+}
+
+double primitiveOverlap(const int la[3], const int lb[3], double a, double b, const double* ca, const double* cb) {
+    double s = std::pow(PI_D / (a + b), 1.5);
+    for (int x = 0; x < 3; ++x) s *= hermiteE(la[x], lb[x], 0, ca[x] - cb[x], a, b);
+    return s;
+}
+
+double kineticIntegral(const BasisFunction& a, const BasisFunction& b) {
+    double sum = 0.0;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            double ea = a.exps[i], eb = b.exps[j];
+            int l2 = b.lmn[0] + b.lmn[1] + b.lmn[2];
+            double t = eb * (2 * l2 + 3) * primitiveOverlap(a.lmn, b.lmn, ea, eb, a.center, b.center);
+            for (int x = 0; x < 3; ++x) {
+                int up[3] = {b.lmn[0], b.lmn[1], b.lmn[2]};
+                up[x] += 2;
+                t -= 2 * eb * eb * primitiveOverlap(a.lmn, up, ea, eb, a.center, b.center);
+                if (b.lmn[x] >= 2) {
+                    int down[3] = {b.lmn[0], b.lmn[1], b.lmn[2]};
+                    down[x] -= 2;
+                    t -= 0.5 * b.lmn[x] * (b.lmn[x] - 1) * primitiveOverlap(a.lmn, down, ea, eb, a.center, b.center);
+                }
+            }
+            sum += a.coefs[i] * b.coefs[j] * t;
+        }
+    }
+    return sum;
+}
+
+struct Nucleus { int z; double pos[3]; };
+
+double nuclearIntegral(const BasisPair& ab, const std::vector<Nucleus>& nuclei) {
+    double sum = 0.0, r[5][5][5];
+    for (const auto& pp : ab.prims) {
+        for (const auto& nuc : nuclei) {
+            double pc[3] = {pp.center[0] - nuc.pos[0], pp.center[1] - nuc.pos[1], pp.center[2] - nuc.pos[2]};
+            hermiteR(ab.l[0] + ab.l[1] + ab.l[2], pp.p, pc, r);
+            double acc = 0.0;
+            for (int t = 0; t <= ab.l[0]; ++t)
+                for (int u = 0; u <= ab.l[1]; ++u)
+                    for (int v = 0; v <= ab.l[2]; ++v)
+                        acc += pp.e[0][t] * pp.e[1][u] * pp.e[2][v] * r[t][u][v];
+            sum -= nuc.z * pp.k * 2 * PI_D / pp.p * acc;
+        }
+    }
+    return sum;
+}
+
+static const double TWO_PI_POW_2_5 = 2.0 * 17.493418327624862; // 2 pi^(5/2)
+
+double electronRepulsion(const BasisPair& ab, const BasisPair& cd) {
+    int L = ab.l[0] + ab.l[1] + ab.l[2] + cd.l[0] + cd.l[1] + cd.l[2];
+    double sum = 0.0, r[5][5][5];
+    for (const auto& p1 : ab.prims) {
+        for (const auto& p2 : cd.prims) {
+            double p = p1.p, q = p2.p, alpha = p * q / (p + q);
+            double pre = TWO_PI_POW_2_5 / (p * q * std::sqrt(p + q));
+            if (p1.bound * p2.bound * pre < 1e-15) continue;
+            double pq[3] = {p1.center[0] - p2.center[0], p1.center[1] - p2.center[1], p1.center[2] - p2.center[2]};
+            hermiteR(L, alpha, pq, r);
+            double acc = 0.0;
+            for (int t = 0; t <= ab.l[0]; ++t)
+                for (int u = 0; u <= ab.l[1]; ++u)
+                    for (int v = 0; v <= ab.l[2]; ++v) {
+                        double e1 = p1.e[0][t] * p1.e[1][u] * p1.e[2][v];
+                        for (int tau = 0; tau <= cd.l[0]; ++tau)
+                            for (int nu = 0; nu <= cd.l[1]; ++nu)
+                                for (int phi = 0; phi <= cd.l[2]; ++phi) {
+                                    double e2 = p2.e[0][tau] * p2.e[1][nu] * p2.e[2][phi];
+                                    double sign = ((tau + nu + phi) & 1) ? -1.0 : 1.0;
+                                    acc += e1 * sign * e2 * r[t + tau][u + nu][v + phi];
+                                }
+                    }
+            sum += p1.k * p2.k * pre * acc;
+        }
+    }
+    return sum;
+}
+
+typedef std::vector<double> Matrix; // row-major, square
+
+// Cyclic Jacobi eigensolver for a symmetric matrix. Eigenvalues come back
+// ascending, eigenvectors as the matching columns of vecs.
+void jacobiEigen(Matrix a, size_t n, std::vector<double>& vals, Matrix& vecs) {
+    vecs.assign(n * n, 0.0);
+    for (size_t i = 0; i < n; ++i) vecs[i * n + i] = 1.0;
+    for (int sweep = 0; sweep < 100; ++sweep) {
+        double off = 0.0;
+        for (size_t i = 0; i < n; ++i) for (size_t j = i + 1; j < n; ++j) off += a[i * n + j] * a[i * n + j];
+        if (off < 1e-22) break;
+        for (size_t p = 0; p < n; ++p) {
+            for (size_t q = p + 1; q < n; ++q) {
+                double apq = a[p * n + q];
+                if (std::abs(apq) < 1e-300) continue;
+                double theta = (a[q * n + q] - a[p * n + p]) / (2 * apq);
+                double t = (theta >= 0 ? 1.0 : -1.0) / (std::abs(theta) + std::sqrt(theta * theta + 1));
+                double c = 1 / std::sqrt(t * t + 1), s = t * c;
+                for (size_t k = 0; k < n; ++k) {
+                    double akp = a[k * n + p], akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (size_t k = 0; k < n; ++k) {
+                    double apk = a[p * n + k], aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (size_t k = 0; k < n; ++k) {
+                    double vkp = vecs[k * n + p], vkq = vecs[k * n + q];
+                    vecs[k * n + p] = c * vkp - s * vkq;
+                    vecs[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t x, size_t y){ return a[x * n + x] < a[y * n + y]; });
+    Matrix sorted(n * n);
+    vals.resize(n);
+    for (size_t c = 0; c < n; ++c) {
+        vals[c] = a[order[c] * n + order[c]];
+        for (size_t r = 0; r < n; ++r) sorted[r * n + c] = vecs[r * n + order[c]];
+    }
+    vecs.swap(sorted);
+}
+
+Matrix matMul(const Matrix& a, const Matrix& b, size_t n, bool transA = false) {
+    Matrix c(n * n, 0.0);
+    for (size_t i = 0; i < n; ++i)
+        for (size_t k = 0; k < n; ++k) {
+            double aik = transA ? a[k * n + i] : a[i * n + k];
+            if (aik == 0.0) continue;
+            for (size_t j = 0; j < n; ++j) c[i * n + j] += aik * b[k * n + j];
+        }
+    return c;
+}
+
+// Solves a small dense system in place (Gaussian elimination, partial pivoting).
+bool solveLinear(std::vector<double> a, std::vector<double>& b, size_t n) {
+    for (size_t col = 0; col < n; ++col) {
+        size_t piv = col;
+        for (size_t r = col + 1; r < n; ++r) if (std::abs(a[r * n + col]) > std::abs(a[piv * n + col])) piv = r;
+        if (std::abs(a[piv * n + col]) < 1e-14) return false;
+        for (size_t k = 0; k < n; ++k) std::swap(a[col * n + k], a[piv * n + k]);
+        std::swap(b[col], b[piv]);
+        for (size_t r = col + 1; r < n; ++r) {
+            double f = a[r * n + col] / a[col * n + col];
+            for (size_t k = col; k < n; ++k) a[r * n + k] -= f * a[col * n + k];
+            b[r] -= f * b[col];
+        }
+    }
+    for (size_t i = n; i-- > 0;) {
+        for (size_t k = i + 1; k < n; ++k) b[i] -= a[i * n + k] * b[k];
+        b[i] /= a[i * n + i];
+    }
+    return true;
+}
+
+struct HFResult {
+    bool ok = false;
+    std::string message;
+    double energy = 0.0; // total, hartree
+    int iterations = 0;
+    int basisSize = 0;
+    double seconds = 0.0;
+};
+
+inline size_t pairIndex(size_t i, size_t j) { return i >= j ? i * (i + 1) / 2 + j : j * (j + 1) / 2 + i; }
+
+std::vector<BasisFunction> buildSto3gBasis(const std::vector<Nucleus>& nuclei) {
+    std::vector<BasisFunction> basis;
+    auto add = [&](const Nucleus& nuc, const double* baseExp, const double* coef, double zeta, int axis){
+        BasisFunction f;
+        for (int x = 0; x < 3; ++x) { f.center[x] = nuc.pos[x]; f.lmn[x] = (x == axis) ? 1 : 0; }
+        for (int k = 0; k < 3; ++k) {
+            f.exps[k] = baseExp[k] * zeta * zeta;
+            double norm = std::pow(2 * f.exps[k] / PI_D, 0.75) * (axis >= 0 ? std::sqrt(4 * f.exps[k]) : 1.0);
+            f.coefs[k] = coef[k] * norm;
+        }
+        // Renormalize the contraction
+        double s = overlapIntegral(makeBasisPair(f, f));
+        for (double& c : f.coefs) c /= std::sqrt(s);
+        basis.push_back(f);
+    };
+    for (const auto& nuc : nuclei) {
+        std::vector<double> zeta = sto3gZetas(nuc.z);
+        add(nuc, STO3G_1S_EXP, STO3G_1S_COEF, zeta[0], -1);
+        if (zeta.size() > 1) {
+            add(nuc, STO3G_2SP_EXP, STO3G_2S_COEF, zeta[1], -1);
+            for (int x = 0; x < 3; ++x) add(nuc, STO3G_2SP_EXP, STO3G_2P_COEF, zeta[1], x);
+        }
+        if (zeta.size() > 2) {
+            add(nuc, STO3G_3SP_EXP, STO3G_3S_COEF, zeta[2], -1);
+            for (int x = 0; x < 3; ++x) add(nuc, STO3G_3SP_EXP, STO3G_3P_COEF, zeta[2], x);
+        }
+    }
+    return basis;
+}
+
+// Restricted closed-shell Hartree-Fock with DIIS. Two-electron integrals are
+// computed once, in parallel over permutationally unique (ij|kl) with i>=j,
+// k>=l, ij>=kl, and Schwarz-screened.
+HFResult runRestrictedHartreeFock(const std::vector<Nucleus>& nuclei) {
+    sf::Clock clock;
+    HFResult res;
+    int electrons = 0;
+    for (const auto& nuc : nuclei) {
+        if (sto3gZetas(nuc.z).empty()) { res.message = "no STO-3G basis for Z=" + std::to_string(nuc.z); return res; }
+        electrons += nuc.z;
+    }
+    if (electrons % 2 != 0) { res.message = "open shell (" + std::to_string(electrons) + " e-), RHF needs pairs"; return res; }
+
+    double enuc = 0.0;
+    for (size_t a = 0; a < nuclei.size(); ++a) {
+        for (size_t b = 0; b < a; ++b) {
+            double d2 = 0.0;
+            for (int x = 0; x < 3; ++x) d2 += (nuclei[a].pos[x] - nuclei[b].pos[x]) * (nuclei[a].pos[x] - nuclei[b].pos[x]);
+            if (d2 < 0.01) { res.message = "atoms overlap"; return res; }
+            enuc += nuclei[a].z * nuclei[b].z / std::sqrt(d2);
+        }
+    }
+
+    std::vector<BasisFunction> basis = buildSto3gBasis(nuclei);
+    size_t n = basis.size(), occ = electrons / 2;
+    res.basisSize = (int)n;
+    // The unique (ij|kl) table holds ~n^4/8 doubles: 100 functions is about 100 MB.
+    if (n > 100) { res.message = "too many basis functions (" + std::to_string(n) + ")"; return res; }
+
+    size_t npairs = n * (n + 1) / 2;
+    std::vector<BasisPair> pairs(npairs);
+    Matrix S(n * n), H(n * n);
+    workerPool().parallelFor(n, 1, [&](size_t b, size_t e){
+        for (size_t i = b; i < e; ++i) {
+            for (size_t j = 0; j <= i; ++j) {
+                BasisPair bp = makeBasisPair(basis[i], basis[j]);
+                double s = overlapIntegral(bp);
+                double h = kineticIntegral(basis[i], basis[j]) + nuclearIntegral(bp, nuclei);
+                S[i * n + j] = S[j * n + i] = s;
+                H[i * n + j] = H[j * n + i] = h;
+                pairs[pairIndex(i, j)] = std::move(bp);
+            }
+        }
+    });
+
+    // Schwarz bounds, then the unique integrals
+    std::vector<double> schwarz(npairs);
+    workerPool().parallelFor(npairs, 16, [&](size_t b, size_t e){
+        for (size_t ij = b; ij < e; ++ij) schwarz[ij] = std::sqrt(std::abs(electronRepulsion(pairs[ij], pairs[ij])));
+    });
+    std::vector<double> eri(npairs * (npairs + 1) / 2, 0.0);
+    workerPool().parallelFor(npairs, 4, [&](size_t b, size_t e){
+        for (size_t ij = b; ij < e; ++ij) {
+            size_t base = ij * (ij + 1) / 2;
+            for (size_t kl = 0; kl <= ij; ++kl) {
+                if (schwarz[ij] * schwarz[kl] < 1e-12) continue;
+                eri[base + kl] = electronRepulsion(pairs[ij], pairs[kl]);
+            }
+        }
+    });
+    pairs.clear();
+
+    // Symmetric orthogonalization X = S^-1/2
+    std::vector<double> sval;
+    Matrix svec;
+    jacobiEigen(S, n, sval, svec);
+    if (sval[0] < 1e-8) { res.message = "basis is linearly dependent"; return res; }
+    Matrix X(n * n, 0.0);
+    for (size_t i = 0; i < n; ++i)
+        for (size_t j = 0; j < n; ++j)
+            for (size_t k = 0; k < n; ++k) X[i * n + j] += svec[i * n + k] * svec[j * n + k] / std::sqrt(sval[k]);
+
+    auto densityFrom = [&](const Matrix& F){
+        Matrix fp = matMul(matMul(X, F, n, true), X, n);
+        std::vector<double> eps;
+        Matrix cp;
+        jacobiEigen(fp, n, eps, cp);
+        Matrix C = matMul(X, cp, n);
+        Matrix D(n * n, 0.0);
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j)
+                for (size_t k = 0; k < occ; ++k) D[i * n + j] += C[i * n + k] * C[j * n + k];
+        return D;
+    };
+
+    // G(D) = 2J - K from the unique integrals, each scaled by its degeneracy.
+    auto twoElectron = [&](const Matrix& D){
+        std::mutex merge;
+        Matrix G(n * n, 0.0);
+        workerPool().parallelFor(n, 1, [&](size_t b, size_t e){
+            Matrix g(n * n, 0.0);
+            for (size_t i = b; i < e; ++i) {
+                for (size_t j = 0; j <= i; ++j) {
+                    size_t ij = pairIndex(i, j);
+                    for (size_t k = 0; k <= i; ++k) {
+                        for (size_t l = 0; l <= (k == i ? j : k); ++l) {
+                            size_t kl = pairIndex(k, l);
+                            double v = eri[ij * (ij + 1) / 2 + kl];
+                            if (v == 0.0) continue;
+                            double deg = (i == j ? 1.0 : 2.0) * (k == l ? 1.0 : 2.0) * (ij == kl ? 1.0 : 2.0);
+                            v *= deg;
+                            g[i * n + j] += v * D[k * n + l];
+                            g[k * n + l] += v * D[i * n + j];
+                            g[j * n + l] -= 0.25 * v * D[i * n + k];
+                            g[j * n + k] -= 0.25 * v * D[i * n + l];
+                            g[i * n + k] -= 0.25 * v * D[j * n + l];
+                            g[i * n + l] -= 0.25 * v * D[j * n + k];
+                        }
+                    }
+                }
+            }
+            std::lock_guard<std::mutex> lk(merge);
+            for (size_t x = 0; x < n * n; ++x) G[x] += g[x];
+        });
+        Matrix sym(n * n);
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j) sym[i * n + j] = 0.5 * (G[i * n + j] + G[j * n + i]);
+        return sym;
+    };
+
+    const size_t DIIS_MAX = 8;
+    std::vector<Matrix> diisF, diisErr;
+    Matrix D = densityFrom(H);
+    double energy = 0.0;
+    for (int it = 1; it <= 128; ++it) {
+        Matrix G = twoElectron(D);
+        Matrix F(n * n);
+        for (size_t x = 0; x < n * n; ++x) F[x] = H[x] + G[x];
+        double eNew = enuc;
+        for (size_t x = 0; x < n * n; ++x) eNew += D[x] * (H[x] + F[x]);
+
+        // DIIS error FDS - SDF in the orthonormal basis
+        Matrix fds = matMul(matMul(F, D, n), S, n);
+        Matrix err(n * n);
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j) err[i * n + j] = fds[i * n + j] - fds[j * n + i];
+        err = matMul(matMul(X, err, n, true), X, n);
+        double rms = 0.0;
+        for (double v : err) rms += v * v;
+        rms = std::sqrt(rms / (n * n));
+
+        res.iterations = it;
+        if (it > 1 && std::abs(eNew - energy) < 1e-9 && rms < 1e-6) { energy = eNew; res.ok = true; break; }
+        energy = eNew;
+
+        diisF.push_back(F);
+        diisErr.push_back(err);
+        if (diisF.size() > DIIS_MAX) { diisF.erase(diisF.begin()); diisErr.erase(diisErr.begin()); }
+        size_t m = diisF.size();
+        if (m >= 2) {
+            std::vector<double> B((m + 1) * (m + 1), 0.0), rhs(m + 1, 0.0);
+            for (size_t a = 0; a < m; ++a) {
+                for (size_t b = 0; b < m; ++b) {
+                    double dot = 0.0;
+                    for (size_t x = 0; x < n * n; ++x) dot += diisErr[a][x] * diisErr[b][x];
+                    B[a * (m + 1) + b] = dot;
+                }
+                B[a * (m + 1) + m] = B[m * (m + 1) + a] = -1.0;
+            }
+            rhs[m] = -1.0;
+            if (solveLinear(B, rhs, m + 1)) {
+                std::fill(F.begin(), F.end(), 0.0);
+                for (size_t a = 0; a < m; ++a)
+                    for (size_t x = 0; x < n * n; ++x) F[x] += rhs[a] * diisF[a][x];
+            }
+        }
+        D = densityFrom(F);
+    }
+    res.energy = energy;
+    res.seconds = clock.getElapsedTime().asSeconds();
+    if (!res.ok) res.message = "SCF did not converge";
+    return res;
+}
+
+// Nuclei of the linked molecule containing seedId. Canvas positions are scaled
+// so the average link is as long as the average covalent bond it represents.
+std::vector<Nucleus> moleculeFromScene(const AtomStore& atoms, const std::vector<Link>& links, int seedId) {
+    std::unordered_map<int, std::vector<int>> adj;
+    for (const auto& L : links) { adj[L.aId].push_back(L.bId); adj[L.bId].push_back(L.aId); }
+    auto present = [&](int id){ return atoms.find(id) != AtomStore::NONE; };
+
+    std::vector<int> ids{seedId}, stack{seedId};
+    while (!stack.empty()) {
+        int cur = stack.back();
+        stack.pop_back();
+        for (int nb : adj[cur]) {
+            if (present(nb) && std::find(ids.begin(), ids.end(), nb) == ids.end()) { ids.push_back(nb); stack.push_back(nb); }
+        }
+    }
+
+    double pixelSum = 0.0, bondSum = 0.0;
+    for (const auto& L : links) {
+        if (std::find(ids.begin(), ids.end(), L.aId) == ids.end() || !present(L.bId)) continue;
+        AtomView A = atoms.view(atoms.find(L.aId));
+        AtomView B = atoms.view(atoms.find(L.bId));
+        pixelSum += length(A.pos - B.pos);
+        bondSum += (covalentRadius(ELEMENTS[A.elementIndex].atomicNumber) +
+                    covalentRadius(ELEMENTS[B.elementIndex].atomicNumber)) * BOHR_PER_ANGSTROM;
+    }
+    double scale = pixelSum > 0.0 ? bondSum / pixelSum : 1.0 / PIXELS_PER_BOHR;
+
+    std::vector<Nucleus> nuclei;
+    for (int id : ids) {
+        AtomView a = atoms.view(atoms.find(id));
+        nuclei.push_back({ELEMENTS[a.elementIndex].atomicNumber, {a.pos.x * scale, a.pos.y * scale, 0.0}});
+    }
+    return nuclei;
+}
+
+// Translation/rotation invariant key: sorted charges plus sorted interatomic
+// distances (0.01 bohr) labelled by the pair of charges.
+std::string canonicalMoleculeKey(const std::vector<Nucleus>& nuclei) {
+    std::vector<int> zs;
+    std::vector<std::string> dists;
+    for (size_t a = 0; a < nuclei.size(); ++a) {
+        zs.push_back(nuclei[a].z);
+        for (size_t b = 0; b < a; ++b) {
+            double d2 = 0.0;
+            for (int x = 0; x < 3; ++x) d2 += (nuclei[a].pos[x] - nuclei[b].pos[x]) * (nuclei[a].pos[x] - nuclei[b].pos[x]);
+            int za = std::min(nuclei[a].z, nuclei[b].z), zb = std::max(nuclei[a].z, nuclei[b].z);
+            dists.push_back(std::to_string(za) + "-" + std::to_string(zb) + ":" + std::to_string((long)std::lround(std::sqrt(d2) * 100)));
+        }
+    }
+    std::sort(zs.begin(), zs.end());
+    std::sort(dists.begin(), dists.end());
+    std::string key;
+    for (int z : zs) key += std::to_string(z) + ",";
+    key += "|";
+    for (const auto& d : dists) key += d + ",";
+    return key;
+}
+
+std::string describeHF(const HFResult& r) {
+    if (!r.ok) return "HF: " + r.message;
+    return "HF: " + std::to_string(r.energy) + " Ha (" + std::to_string(r.iterations) + " it, " +
+           std::to_string(r.basisSize) + " bf)";
+}
+
+// ---- Wavepacket (split-operator TDSE) ----
+
+typedef std::complex<float> cfloat;
+
+// Plain complex multiply; std::complex's operator* goes through the
+// NaN-checking library path unless -ffast-math is on.
+inline cfloat cmul(cfloat a, cfloat b) {
+    return {a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real()};
+}
+
+// Iterative radix-2 FFT for one power-of-two length.
+struct FFTPlan {
+    size_t n = 0;
+    std::vector<uint32_t> bitrev;
+    std::vector<cfloat> twiddle; // e^(-2 pi i k / n), k < n/2
+
+    explicit FFTPlan(size_t size = 0) : n(size), bitrev(size), twiddle(size / 2) {
+        int bits = 0;
+        while (((size_t)1 << bits) < n) ++bits;
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t r = 0;
+            for (int b = 0; b < bits; ++b) if (i >> b & 1) r |= 1u << (bits - 1 - b);
+            bitrev[i] = r;
+        }
+        for (size_t k = 0; k < n / 2; ++k) {
+            double a = -2.0 * 3.14159265358979323846 * k / n;
+            twiddle[k] = cfloat((float)std::cos(a), (float)std::sin(a));
+        }
+    }
+
+    // In place; the inverse is unscaled.
+    void run(cfloat* a, bool inverse) const {
+        for (size_t i = 0; i < n; ++i) if (i < bitrev[i]) std::swap(a[i], a[bitrev[i]]);
+        for (size_t len = 2; len <= n; len <<= 1) {
+            size_t half = len >> 1, stride = n / len;
+            for (size_t i = 0; i < n; i += len) {
+                for (size_t j = 0; j < half; ++j) {
+                    cfloat w = twiddle[j * stride];
+                    if (inverse) w = std::conj(w);
+                    cfloat u = a[i + j], v = cmul(a[i + j + half], w);
+                    a[i + j] = u + v;
+                    a[i + j + half] = u - v;
+                }
+            }
+        }
+    }
+};
+
+// Out-of-place transpose of an n x n grid in cache-sized tiles, tile rows in parallel.
+void transposeBlocked(const std::vector<cfloat>& src, std::vector<cfloat>& dst, size_t n) {
+    const size_t TILE = 32;
+    size_t tiles = (n + TILE - 1) / TILE;
+    workerPool().parallelFor(tiles, 1, [&](size_t b, size_t e){
+        for (size_t ti = b; ti < e; ++ti) {
+            for (size_t tj = 0; tj < tiles; ++tj) {
+                size_t i1 = std::min(n, (ti + 1) * TILE), j1 = std::min(n, (tj + 1) * TILE);
+                for (size_t i = ti * TILE; i < i1; ++i)
+                    for (size_t j = tj * TILE; j < j1; ++j)
+                        dst[j * n + i] = src[i * n + j];
+            }
+        }
+    });
+}
+
+// 2D FFT of a square grid: parallel row FFTs, blocked transpose, row FFTs again.
+// The result is left transposed; applying it twice restores the layout, which
+// is all a forward/inverse pair in the split-operator step needs.
+void fft2dTransposed(std::vector<cfloat>& a, std::vector<cfloat>& scratch, const FFTPlan& plan, bool inverse) {
+    size_t n = plan.n;
+    auto rows = [&](std::vector<cfloat>& g){
+        workerPool().parallelFor(n, 8, [&](size_t b, size_t e){
+            for (size_t r = b; r < e; ++r) plan.run(&g[r * n], inverse);
+        });
+    };
+    rows(a);
+    transposeBlocked(a, scratch, n);
+    a.swap(scratch);
+    rows(a);
+}
+
+// One electron wavefunction on a square grid over the canvas, evolved with the
+// Strang split-operator method in atomic units. Each atom adds a softened
+// Coulomb well -Zeff / sqrt(r^2 + a^2); the grid is periodic.
+class WavepacketSolver {
+public:
+    static const unsigned GRID = 512;
+
+    bool ready() const { return n != 0; }
+
+    void reset(const sf::FloatRect& area) {
+        n = GRID;
+        origin = {area.left, area.top};
+        cellPx = std::max(area.width, area.height) / n;
+        h = cellPx / PIXELS_PER_BOHR;
+        plan = FFTPlan(n);
+        psi.assign(n * n, cfloat(0.f, 0.f));
+        scratch.assign(n * n, cfloat(0.f, 0.f));
+        potential.assign(n * n, 0.f);
+        potentialPhase.assign(n * n, cfloat(1.f, 0.f));
+        kineticPhase.assign(n * n, cfloat(1.f, 0.f));
+        sources.clear();
+        tablesDt = -1.f;
+        pixels.assign(n * n * 4, 0);
+        texture.create(n, n);
+        texture.setSmooth(true);
+    }
+
+    // Gaussian packet centred at a canvas pixel with momentum (kx, ky) in 1/bohr.
+    void launch(sf::Vector2f pixelPos, float kx, float ky, float sigmaBohr = 2.f) {
+        float cx = (pixelPos.x - origin.x) / cellPx * h, cy = (pixelPos.y - origin.y) / cellPx * h;
+        double norm = 0.0;
+        for (unsigned r = 0; r < n; ++r) {
+            for (unsigned c = 0; c < n; ++c) {
+                float x = c * h - cx, y = r * h - cy;
+                float amp = std::exp(-(x*x + y*y) / (4.f * sigmaBohr * sigmaBohr));
+                float ph = kx * x + ky * y;
+                psi[r * n + c] = cfloat(amp * std::cos(ph), amp * std::sin(ph));
+                norm += amp * amp;
+            }
+        }
+        float s = (float)(1.0 / std::sqrt(norm * h * h));
+        for (auto& v : psi) v *= s;
+    }
+
+    // Brings the potential up to date with the atoms. A few added, removed or
+    // moved atoms are patched in as well differences; past that (thermal motion
+    // moves everything) the grid is rebuilt in one pass, which also clears the
+    // rounding drift the patches accumulate.
+    void syncPotential(const AtomStore& atoms) {
+        current.clear();
+        for (const auto& a : atoms) current.push_back({a.id, {a.pos, valenceZeff(ELEMENTS[a.elementIndex].atomicNumber)}});
+        auto byId = [](const Placed& x, const Placed& y){ return x.id < y.id; };
+        if (!std::is_sorted(current.begin(), current.end(), byId)) std::sort(current.begin(), current.end(), byId);
+
+        // Both lists are sorted by id: walk them together, counting wells to patch
+        size_t changed = 0, i = 0, j = 0;
+        while (i < sources.size() || j < current.size()) {
+            if (j == current.size() || (i < sources.size() && sources[i].id < current[j].id)) { changed += 1; ++i; }
+            else if (i == sources.size() || current[j].id < sources[i].id) { changed += 1; ++j; }
+            else { if (sources[i].src.pos != current[j].src.pos) changed += 2; ++i; ++j; }
+        }
+        if (changed > MAX_PATCHES) {
+            rebuildPotential(current);
+        } else if (changed > 0) {
+            i = j = 0;
+            while (i < sources.size() || j < current.size()) {
+                if (j == current.size() || (i < sources.size() && sources[i].id < current[j].id)) addWell(sources[i++].src, -1.f);
+                else if (i == sources.size() || current[j].id < sources[i].id) addWell(current[j++].src, 1.f);
+                else {
+                    if (sources[i].src.pos != current[j].src.pos) { addWell(sources[i].src, -1.f); addWell(current[j].src, 1.f); }
+                    ++i; ++j;
+                }
+            }
+        }
+        sources.swap(current);
+    }
+
+    void step(float dt) {
+        if (dt != tablesDt) buildKinetic(dt);
+        if (dt != tablesDt || potentialDirty) buildPotentialPhase(dt);
+        tablesDt = dt;
+
+        auto multiply = [&](const std::vector<cfloat>& phase){
+            workerPool().parallelFor(n, 16, [&](size_t b, size_t e){
+                for (size_t i = b * n; i < e * n; ++i) psi[i] = cmul(psi[i], phase[i]);
+            });
+        };
+        multiply(potentialPhase);
+        fft2dTransposed(psi, scratch, plan, false);
+        multiply(kineticPhase);
+        fft2dTransposed(psi, scratch, plan, true);
+        multiply(potentialPhase);
+    }
+
+    void draw(sf::RenderWindow& window) {
+        float peak = 0.f;
+        for (const auto& v : psi) peak = std::max(peak, std::norm(v));
+        float inv = peak > 0.f ? 1.f / peak : 0.f;
+        for (size_t i = 0; i < psi.size(); ++i) {
+            float d = std::sqrt(std::norm(psi[i]) * inv);
+            pixels[i * 4 + 0] = 120;
+            pixels[i * 4 + 1] = (sf::Uint8)(140 + 115 * d);
+            pixels[i * 4 + 2] = 255;
+            pixels[i * 4 + 3] = (sf::Uint8)(230 * d);
+        }
+        texture.update(pixels.data());
+        sf::Sprite sprite(texture);
+        sprite.setPosition(origin);
+        sprite.setScale(cellPx, cellPx);
+        window.draw(sprite);
+    }
+
+private:
+    struct Source { sf::Vector2f pos; float zeff; };
+
+    struct Placed { int id; Source src; };
+    static constexpr size_t MAX_PATCHES = 8; // whole-grid well passes before a rebuild is cheaper
+
+    float wellDepth(const Source& src, float x, float y) const {
+        return src.zeff / std::sqrt(x*x + y*y + 0.5f * 0.5f);
+    }
+
+    void rebuildPotential(const std::vector<Placed>& placed) {
+        workerPool().parallelFor(n, 16, [&](size_t b, size_t e){
+            for (size_t r = b; r < e; ++r) {
+                float* row = potential.data() + r * n;
+                std::fill(row, row + n, 0.f);
+                for (const Placed& p : placed) {
+                    float cx = (p.src.pos.x - origin.x) / cellPx * h, cy = (p.src.pos.y - origin.y) / cellPx * h;
+                    float y = r * h - cy;
+                    for (unsigned c = 0; c < n; ++c) row[c] -= wellDepth(p.src, c * h - cx, y);
+                }
+            }
+        });
+        potentialDirty = true;
+    }
+
+    void addWell(const Source& src, float sign) {
+        float cx = (src.pos.x - origin.x) / cellPx * h, cy = (src.pos.y - origin.y) / cellPx * h;
+        workerPool().parallelFor(n, 16, [&](size_t b, size_t e){
+            for (size_t r = b; r < e; ++r) {
+                float y = r * h - cy;
+                for (unsigned c = 0; c < n; ++c) potential[r * n + c] -= sign * wellDepth(src, c * h - cx, y);
+            }
+        });
+        potentialDirty = true;
+    }
+
+    // exp(-i k^2/2 dt) with the 1/n^2 of the unscaled inverse FFT folded in.
+    // k^2 is symmetric in the two indices, so the transposed layout needs no care.
+    void buildKinetic(float dt) {
+        float dk = 2.f * 3.14159265f / (n * h), scale = 1.f / ((float)n * n);
+        for (unsigned r = 0; r < n; ++r) {
+            float ky = ((r < n / 2) ? (float)r : (float)r - n) * dk;
+            for (unsigned c = 0; c < n; ++c) {
+                float kx = ((c < n / 2) ? (float)c : (float)c - n) * dk;
+                float a = -0.5f * (kx*kx + ky*ky) * dt;
+                kineticPhase[r * n + c] = cfloat(scale * std::cos(a), scale * std::sin(a));
+            }
+        }
+    }
+
+    // exp(-i V dt/2) for the two half steps.
+    void buildPotentialPhase(float dt) {
+        workerPool().parallelFor(n, 16, [&](size_t b, size_t e){
+            for (size_t i = b * n; i < e * n; ++i) {
+                float a = -0.5f * potential[i] * dt;
+                potentialPhase[i] = cfloat(std::cos(a), std::sin(a));
+            }
+        });
+        potentialDirty = false;
+    }
+
+    unsigned n = 0;
+    float cellPx = 1.f, h = 1.f; // cell size in pixels and in bohr
+    sf::Vector2f origin;
+    FFTPlan plan;
+    std::vector<cfloat> psi, scratch, kineticPhase, potentialPhase;
+    std::vector<float> potential;
+    std::vector<Placed> sources, current; // sorted by atom id; current is per-call scratch
+    bool potentialDirty = true;
+    float tablesDt = -1.f;
+    sf::Texture texture;
+    std::vector<sf::Uint8> pixels;
+};
+
+// ---- Spectrum ----
+
+static const float HARTREE_EV = 27.211386f;
+
+struct SpectralLine { float energyEv; float strength; };
+
+// Dipole-allowed (|dl| = 1) lines between the valence subshell and excited
+// levels up to n = 6, l <= 2, all solved in the ground-state central field.
+// Strengths use the hydrogenic (2l'+1)/n'^3 trend; cascades between excited
+// levels are weighted down.
+std::vector<SpectralLine> elementLines(int atomicNumber) {
+    auto cfg = electronConfiguration(atomicNumber);
+    const Subshell& valence = cfg.back();
+    auto full = [&](int n, int l){
+        for (const auto& s : cfg) if (s.n == n && s.l == l) return s.electrons == 2 * (2 * l + 1);
+        return false;
+    };
+    struct State { int n, l; float e; bool ground; };
+    std::vector<State> states;
+    states.push_back({valence.n, valence.l, solveRadialLevel(atomicNumber, valence.n, valence.l).energy, true});
+    for (int l = 0; l <= 2; ++l) {
+        for (int n = std::max(l + 1, valence.n); n <= 6; ++n) {
+            if ((n == valence.n && l == valence.l) || full(n, l)) continue;
+            RadialLevel lv = solveRadialLevel(atomicNumber, n, l);
+            if (lv.bound) states.push_back({n, l, lv.energy, false});
+        }
+    }
+    std::vector<SpectralLine> lines;
+    for (const auto& lo : states) {
+        for (const auto& up : states) {
+            if (std::abs(lo.l - up.l) != 1 || up.e <= lo.e) continue;
+            float strength = (2 * up.l + 1) / (float)(up.n * up.n * up.n) * (lo.ground ? 1.f : 0.3f);
+            lines.push_back({(up.e - lo.e) * HARTREE_EV, strength});
+        }
+    }
+    return lines;
+}
+
+// Approximate RGB for a visible wavelength; outside 380-750 nm returns grey.
+sf::Color wavelengthColor(float nm) {
+    float r = 0, g = 0, b = 0;
+    if (nm < 380 || nm > 750) return sf::Color(120,120,130);
+    if (nm < 440) { r = (440 - nm) / 60; b = 1; }
+    else if (nm < 490) { g = (nm - 440) / 50; b = 1; }
+    else if (nm < 510) { g = 1; b = (510 - nm) / 20; }
+    else if (nm < 580) { r = (nm - 510) / 70; g = 1; }
+    else if (nm < 645) { r = 1; g = (645 - nm) / 65; }
+    else r = 1;
+    return sf::Color((sf::Uint8)(255 * r), (sf::Uint8)(255 * g), (sf::Uint8)(255 * b));
+}
+
+// Emission spectrum of all active atoms. Each element's lines are binned once;
+// the scene spectrum is sum(activeCount[el] * lines[el]) broadened by an FFT
+// convolution with a Lorentzian, redone only when an active count changes, so
+// the cost does not depend on how many atoms there are.
+class SpectrumEngine {
+public:
+    static const int BINS = 1024;
+    static constexpr float MAX_EV = 14.f;
+    static constexpr float FWHM_EV = 0.08f;
+
+    void atomActivated(int elementIndex, int delta) {
+        if (counts.empty()) counts.assign(ELEMENTS.size(), 0);
+        counts[elementIndex] += delta;
+        dirty = true;
+    }
+
+    void reset() {
+        counts.assign(ELEMENTS.size(), 0);
+        dirty = true;
+    }
+
+    const std::vector<float>& spectrum() {
+        if (lineHist.empty()) build();
+        if (!dirty) return broadened;
+        std::fill(raw.begin(), raw.end(), 0.f);
+        for (size_t el = 0; el < ELEMENTS.size(); ++el) {
+            float w = (float)counts[el];
+            if (w == 0.f) continue;
+            const float* h = lineHist[el].data();
+            float* out = raw.data();
+            for (int b = 0; b < BINS; ++b) out[b] += w * h[b];
+        }
+        for (size_t i = 0; i < work.size(); ++i) work[i] = cfloat(i < (size_t)BINS ? raw[i] : 0.f, 0.f);
+        plan.run(work.data(), false);
+        for (size_t i = 0; i < work.size(); ++i) work[i] = cmul(work[i], kernelFft[i]);
+        plan.run(work.data(), true);
+        float scale = 1.f / work.size();
+        for (int b = 0; b < BINS; ++b) broadened[b] = std::max(0.f, work[b].real() * scale);
+        dirty = false;
+        return broadened;
+    }
+
+    void draw(sf::RenderWindow& window, const sf::Font& font, const sf::FloatRect& area) {
+        const std::vector<float>& spec = spectrum();
+        float peak = *std::max_element(spec.begin(), spec.end());
+        sf::RectangleShape bg({area.width, area.height});
+        bg.setPosition(area.left, area.top);
+        bg.setFillColor(sf::Color(8,8,12,220));
+        bg.setOutlineThickness(1.f);
+        bg.setOutlineColor(sf::Color(60,60,70));
+        window.draw(bg);
+
+        sf::VertexArray bars(sf::Lines);
+        int columns = (int)area.width;
+        for (int c = 0; c < columns; ++c) {
+            int b0 = c * BINS / columns, b1 = std::max(b0 + 1, (c + 1) * BINS / columns);
+            float v = 0.f;
+            for (int b = b0; b < b1; ++b) v = std::max(v, spec[b]);
+            if (peak <= 0.f || v <= 0.f) continue;
+            float ev = (c + 0.5f) / columns * MAX_EV;
+            sf::Color col = wavelengthColor(1239.84f / ev);
+            float top = area.top + area.height - 4.f - (area.height - 8.f) * std::sqrt(v / peak);
+            bars.append(sf::Vertex({area.left + c, area.top + area.height - 4.f}, col));
+            bars.append(sf::Vertex({area.left + c, top}, col));
+        }
+        window.draw(bars);
+        if (font.getInfo().family != "") {
+            window.draw(makeText("0 eV", font, 12, sf::Color(160,160,170), {area.left + 4, area.top + 2}));
+            window.draw(makeText(std::to_string((int)MAX_EV) + " eV", font, 12, sf::Color(160,160,170), {area.left + area.width - 40, area.top + 2}));
+        }
+    }
+
+private:
+    void build() {
+        if (counts.empty()) counts.assign(ELEMENTS.size(), 0);
+        lineHist.assign(ELEMENTS.size(), std::vector<float>(BINS, 0.f));
+        workerPool().parallelFor(ELEMENTS.size(), 1, [&](size_t b, size_t e){
+            for (size_t el = b; el < e; ++el) {
+                for (const auto& line : elementLines(ELEMENTS[el].atomicNumber)) {
+                    // Split each line between its two nearest bins
+                    float x = line.energyEv / MAX_EV * BINS - 0.5f;
+                    int i = (int)std::floor(x);
+                    float f = x - i;
+                    if (i >= 0 && i < BINS) lineHist[el][i] += line.strength * (1.f - f);
+                    if (i + 1 >= 0 && i + 1 < BINS) lineHist[el][i + 1] += line.strength * f;
+                }
+            }
+        });
+        size_t n = 1;
+        while (n < 2 * (size_t)BINS) n <<= 1;
+        plan = FFTPlan(n);
+        work.assign(n, cfloat(0.f, 0.f));
+        kernelFft.assign(n, cfloat(0.f, 0.f));
+        float gamma = 0.5f * FWHM_EV / MAX_EV * BINS; // half width in bins
+        for (size_t i = 0; i < n; ++i) {
+            float d = (i < n / 2) ? (float)i : (float)i - n;
+            kernelFft[i] = cfloat(gamma / (3.14159265f * (d * d + gamma * gamma)), 0.f);
+        }
+        plan.run(kernelFft.data(), false);
+        raw.assign(BINS, 0.f);
+        broadened.assign(BINS, 0.f);
+        dirty = true;
+    }
+
+    std::vector<std::vector<float>> lineHist; // per element
+    std::vector<int> counts;                  // active atoms per element
+    std::vector<float> raw, broadened;
+    FFTPlan plan;
+    std::vector<cfloat> kernelFft, work;
+    bool dirty = true;
+};
+
+// ---- Photons ----
+
+// xorshift32; plenty for visual randomness and much cheaper than std::rand.
+struct FastRng {
+    uint32_t state;
+    explicit FastRng(uint32_t seed = 2463534242u) : state(seed ? seed : 1u) {}
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    float uniform() { return (next() >> 8) * (1.f / 16777216.f); } // [0, 1)
+};
+
+// Uniform bucket grid over atom positions, rebuilt with a counting sort so a
+// rebuild is two passes and no per-cell allocations. With reach > 0 every atom
+// is also listed in each cell within `reach` of it, so "is anything within
+// reach of p" becomes a single-cell lookup (forEachInCell).
+struct SpatialGrid {
+    float cell = 32.f;
+    float originX = 0.f, originY = 0.f;
+    int cols = 0, rows = 0;
+    std::vector<int> cellStart; // cols*rows + 1 offsets into items
+    std::vector<int> items;     // atom indices grouped by cell
+
+    void build(const AtomStore& atoms, float cellSize, float reach = 0.f) {
+        build(atoms.size(), [&](size_t i){ return atoms[i].pos; }, cellSize, reach);
+    }
+
+    void build(const std::vector<sf::Vector2f>& points, float cellSize, float reach = 0.f) {
+        build(points.size(), [&](size_t i){ return points[i]; }, cellSize, reach);
+    }
+
+    template <class PosOf>
+    void build(size_t count, PosOf posOf, float cellSize, float reach) {
+        cell = cellSize;
+        if (count == 0) { cols = rows = 0; cellStart.assign(1, 0); items.clear(); return; }
+        float minX = posOf(0).x, minY = posOf(0).y, maxX = minX, maxY = minY;
+        for (size_t i = 0; i < count; ++i) {
+            sf::Vector2f p = posOf(i);
+            minX = std::min(minX, p.x); maxX = std::max(maxX, p.x);
+            minY = std::min(minY, p.y); maxY = std::max(maxY, p.y);
+        }
+        originX = minX - reach;
+        originY = minY - reach;
+        cols = (int)((maxX - minX + 2 * reach) / cell) + 1;
+        rows = (int)((maxY - minY + 2 * reach) / cell) + 1;
+        cellStart.assign((size_t)cols * rows + 1, 0);
+        auto forCells = [&](sf::Vector2f p, auto&& fn){
+            int x0 = (int)((p.x - reach - originX) / cell), x1 = (int)((p.x + reach - originX) / cell);
+            int y0 = (int)((p.y - reach - originY) / cell), y1 = (int)((p.y + reach - originY) / cell);
+            for (int cy = y0; cy <= y1; ++cy)
+                for (int cx = x0; cx <= x1; ++cx) fn(cy * cols + cx);
+        };
+        for (size_t i = 0; i < count; ++i) forCells(posOf(i), [&](int c){ ++cellStart[c + 1]; });
+        for (size_t c = 1; c < cellStart.size(); ++c) cellStart[c] += cellStart[c - 1];
+        items.resize(cellStart.back());
+        std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < count; ++i) forCells(posOf(i), [&](int c){ items[fill[c]++] = (int)i; });
+    }
+
+    // Calls fn(atomIndex) for every atom bucketed in the cell containing p.
+    template <class F>
+    void forEachInCell(sf::Vector2f p, F&& fn) const {
+        float fx = (p.x - originX) / cell, fy = (p.y - originY) / cell;
+        if (fx < 0.f || fy < 0.f || fx >= cols || fy >= rows) return;
+        int c = (int)fy * cols + (int)fx;
+        for (int k = cellStart[c]; k < cellStart[c + 1]; ++k) fn(items[k]);
+    }
+
+    // Calls fn(atomIndex) for every atom in the cells overlapping the circle.
+    template <class F>
+    void forEachNear(sf::Vector2f p, float radius, F&& fn) const {
+        if (cols == 0) return;
+        int x0 = (int)std::floor((p.x - radius - originX) / cell), x1 = (int)std::floor((p.x + radius - originX) / cell);
+        int y0 = (int)std::floor((p.y - radius - originY) / cell), y1 = (int)std::floor((p.y + radius - originY) / cell);
+        x0 = std::max(x0, 0); y0 = std::max(y0, 0);
+        x1 = std::min(x1, cols - 1); y1 = std::min(y1, rows - 1);
+        for (int cy = y0; cy <= y1; ++cy)
+            for (int cx = x0; cx <= x1; ++cx) {
+                int c = cy * cols + cx;
+                for (int k = cellStart[c]; k < cellStart[c + 1]; ++k) fn(items[k]);
+            }
+    }
+};
+
+// Fixed-capacity photon pool in SoA layout. Dead slots go on a free list and
+// are reused, so emitting never allocates. Everything below the high-water
+// mark is integrated in one straight loop; dead slots just drift harmlessly.
+class PhotonPool {
+public:
+    static const size_t CAPACITY = 1 << 20;
+    static constexpr float SPEED = 180.f;   // px/s
+    static constexpr float LIFETIME = 2.5f; // s
+
+    bool ready() const { return !x.empty(); }
+
+    void init() {
+        x.assign(CAPACITY, 0.f); y.assign(CAPACITY, 0.f);
+        vx.assign(CAPACITY, 0.f); vy.assign(CAPACITY, 0.f);
+        life.assign(CAPACITY, 0.f);
+        color.assign(CAPACITY, sf::Color::White);
+        source.assign(CAPACITY, -1);
+        alive.assign(CAPACITY, 0);
+        freeList.clear();
+        freeList.reserve(CAPACITY);
+        verts.resize(CAPACITY * 4);
+        highWater = liveCount = 0;
+    }
+
+    void clear() {
+        std::fill(alive.begin(), alive.end(), 0);
+        std::fill(life.begin(), life.end(), 0.f);
+        freeList.clear();
+        highWater = liveCount = 0;
+    }
+
+    size_t live() const { return liveCount; }
+
+    bool emit(sf::Vector2f p, float angle, sf::Color c, int sourceId) {
+        size_t i;
+        if (!freeList.empty()) { i = freeList.back(); freeList.pop_back(); }
+        else if (highWater < CAPACITY) i = highWater++;
+        else return false;
+        x[i] = p.x; y[i] = p.y;
+        vx[i] = std::cos(angle) * SPEED; vy[i] = std::sin(angle) * SPEED;
+        life[i] = LIFETIME;
+        color[i] = c;
+        source[i] = sourceId;
+        alive[i] = 1;
+        ++liveCount;
+        return true;
+    }
+
+    void integrate(float dt) {
+        float* px = x.data(); float* py = y.data();
+        const float* pvx = vx.data(); const float* pvy = vy.data();
+        float* pl = life.data();
+        for (size_t i = 0; i < highWater; ++i) {
+            px[i] += pvx[i] * dt;
+            py[i] += pvy[i] * dt;
+            pl[i] -= dt;
+        }
+    }
+
+    // Photons that enter a nucleus other than their emitter's are absorbed.
+    // Returns the indices of the absorbing atoms (one entry per photon). The
+    // grid must be built with reach >= the nucleus radius.
+    void absorb(const AtomStore& atoms, const SpatialGrid& grid, std::vector<int>& hits) {
+        std::mutex m;
+        workerPool().parallelFor(highWater, 4096, [&](size_t b, size_t e){
+            std::vector<int> local;
+            for (size_t i = b; i < e; ++i) {
+                if (!alive[i] || life[i] <= 0.f) continue;
+                sf::Vector2f p(x[i], y[i]);
+                int hit = -1;
+                grid.forEachInCell(p, [&](int ai){
+                    AtomView a = atoms[ai];
+                    sf::Vector2f d = p - a.pos;
+                    if (hit == -1 && a.id != source[i] && d.x*d.x + d.y*d.y <= a.nucleusRadius * a.nucleusRadius) hit = ai;
+                });
+                if (hit != -1) { life[i] = 0.f; local.push_back(hit); }
+            }
+            if (!local.empty()) {
+                std::lock_guard<std::mutex> lk(m);
+                hits.insert(hits.end(), local.begin(), local.end());
+            }
+        });
+    }
+
+    // Returns expired slots to the free list and trims the high-water mark.
+    void collect() {
+        for (size_t i = 0; i < highWater; ++i) {
+            if (alive[i] && life[i] <= 0.f) {
+                alive[i] = 0;
+                freeList.push_back((uint32_t)i);
+                --liveCount;
+            }
+        }
+        if (liveCount == 0) { freeList.clear(); highWater = 0; }
+    }
+
+    void draw(sf::RenderWindow& window) {
+        size_t n = 0;
+        for (size_t i = 0; i < highWater; ++i) {
+            if (!alive[i]) continue;
+            sf::Color c = color[i];
+            c.a = (sf::Uint8)(255.f * std::min(1.f, life[i] / 0.5f));
+            sf::Vertex* q = &verts[n * 4];
+            q[0] = sf::Vertex({x[i] - 1.5f, y[i] - 1.5f}, c);
+            q[1] = sf::Vertex({x[i] + 1.5f, y[i] - 1.5f}, c);
+            q[2] = sf::Vertex({x[i] + 1.5f, y[i] + 1.5f}, c);
+            q[3] = sf::Vertex({x[i] - 1.5f, y[i] + 1.5f}, c);
+            ++n;
+        }
+        if (n) window.draw(verts.data(), n * 4, sf::Quads);
+    }
+
+private:
+    std::vector<float> x, y, vx, vy, life;
+    std::vector<sf::Color> color;
+    std::vector<int> source;
+    std::vector<sf::Uint8> alive;
+    std::vector<uint32_t> freeList;
+    std::vector<sf::Vertex> verts;
+    size_t highWater = 0, liveCount = 0;
+};
+
+// 16 photon colours per element, drawn from its lines in proportion to strength.
+const std::vector<sf::Color>& photonPalette(int elementIndex) {
+    static std::vector<std::vector<sf::Color>> palettes;
+    if (palettes.empty()) {
+        for (const auto& el : ELEMENTS) {
+            std::vector<SpectralLine> lines = elementLines(el.atomicNumber);
+            std::vector<sf::Color> pal;
+            float total = 0.f;
+            for (const auto& l : lines) total += l.strength;
+            float acc = 0.f;
+            size_t li = 0;
+            for (int k = 0; k < 16 && !lines.empty(); ++k) {
+                float target = (k + 0.5f) / 16.f * total;
+                while (li + 1 < lines.size() && acc + lines[li].strength < target) acc += lines[li++].strength;
+                pal.push_back(wavelengthColor(1239.84f / lines[li].energyEv));
+            }
+            if (pal.empty()) pal.push_back(el.color);
+            palettes.push_back(pal);
+        }
+    }
+    return palettes[elementIndex];
+}
+
+// ---- Reaction kinetics ----
+
+// Usual covalent valence, i.e. how many links an atom accepts before it stops bonding.
+int typicalValence(int atomicNumber) {
+    switch (atomicNumber) {
+    case 1: case 3: case 9: case 11: case 17: return 1;
+    case 2: case 10: case 18: return 0;
+    case 4: case 8: return 2;
+    case 5: case 7: return 3;
+    case 6: case 14: return 4;
+    default: return 2;
+    }
+}
+
+float paulingElectronegativity(int atomicNumber) {
+    switch (atomicNumber) {
+    case 1: return 2.20f;
+    case 3: return 0.98f;
+    case 4: return 1.57f;
+    case 5: return 2.04f;
+    case 6: return 2.55f;
+    case 7: return 3.04f;
+    case 8: return 3.44f;
+    case 11: return 0.93f;
+    case 17: return 3.16f;
+    default: return 0.f;
+    }
+}
+
+// Stochastic bond formation/breaking between nearby atoms, simulated with the
+// Gibson-Bruck next reaction method. Every pair within CUTOFF is one channel
+// that flips its bond state. Formation needs free valence on both atoms and
+// slows with distance; breaking is slower for more polar bonds. Putative
+// firing times sit in an indexed binary heap, and since a channel's rate only
+// depends on the degrees of its two atoms, the channels sharing an atom form
+// the dependency graph. An event costs O(deg * log R).
+class BondKinetics {
+public:
+    static constexpr float CUTOFF = 110.f;     // px
+    static constexpr double FORM_RATE = 2.0;   // 1/s at zero distance
+    static constexpr double BREAK_RATE = 0.3;  // 1/s for a non-polar bond
+
+    double time() const { return now; }
+    size_t channelCount() const { return ch.size(); }
+
+    // Called with (aId, bId, formed) for every bond advance() applies to `links`
+    std::function<void(int, int, bool)> onBond;
+
+    // (Re)creates the channels from the scene. `links` may already contain
+    // bonds; those between channel pairs are adopted.
+    void build(const AtomStore& atoms, const std::vector<Link>& links, double t) {
+        now = t;
+        size_t n = atoms.size();
+        // Number atoms in grid-cell order so neighbours (and their channels)
+        // sit close together in memory; events touch only local data that way.
+        grid.build(atoms, CUTOFF);
+        std::vector<int> local(n);
+        order.clear();
+        for (size_t c = 0; c + 1 < grid.cellStart.size(); ++c)
+            for (int k = grid.cellStart[c]; k < grid.cellStart[c + 1]; ++k) {
+                local[grid.items[k]] = (int)order.size();
+                order.push_back(grid.items[k]);
+            }
+        ids.resize(n); element.resize(n); valence.resize(n);
+        degree.assign(n, 0);
+        std::unordered_map<int, int> indexOf;
+        for (size_t i = 0; i < n; ++i) {
+            AtomView a = atoms[order[i]];
+            ids[i] = a.id;
+            element[i] = ELEMENTS[a.elementIndex].atomicNumber;
+            valence[i] = typicalValence(element[i]);
+            indexOf[a.id] = (int)i;
+        }
+
+        ch.clear();
+        std::unordered_map<uint64_t, int> pairChannel;
+        for (size_t i = 0; i < n; ++i) {
+            AtomView ai = atoms[order[i]];
+            grid.forEachNear(ai.pos, CUTOFF, [&](int other){
+                int j = local[other];
+                if (j <= (int)i) return;
+                float d = length(ai.pos - atoms[other].pos);
+                if (d > CUTOFF) return;
+                float dchi = std::abs(paulingElectronegativity(element[i]) - paulingElectronegativity(element[j]));
+                Channel c{(int)i, j, FORM_RATE * std::exp(-d / 60.0), BREAK_RATE * std::exp(-1.5 * dchi), 0.0, 0.0, false, -1};
+                pairChannel[pairKey(ai.id, atoms[other].id)] = (int)ch.size();
+                ch.push_back(c);
+            });
+        }
+
+        // Dependency graph in CSR form: the channels touching each atom
+        depStart.assign(n + 1, 0);
+        for (const auto& c : ch) { ++depStart[c.a + 1]; ++depStart[c.b + 1]; }
+        for (size_t i = 0; i < n; ++i) depStart[i + 1] += depStart[i];
+        deps.resize(depStart[n]);
+        std::vector<int> fill(depStart.begin(), depStart.end() - 1);
+        for (size_t c = 0; c < ch.size(); ++c) {
+            deps[fill[ch[c].a]++] = (int)c;
+            deps[fill[ch[c].b]++] = (int)c;
+        }
+
+        linkChannel.assign(links.size(), -1);
+        for (size_t k = 0; k < links.size(); ++k) {
+            auto ia = indexOf.find(links[k].aId), ib = indexOf.find(links[k].bId);
+            if (ia == indexOf.end() || ib == indexOf.end()) continue;
+            ++degree[ia->second];
+            ++degree[ib->second];
+            auto it = pairChannel.find(pairKey(links[k].aId, links[k].bId));
+            if (it != pairChannel.end()) {
+                ch[it->second].linked = true;
+                ch[it->second].linkSlot = (int)k;
+                linkChannel[k] = it->second;
+            }
+        }
+
+        heap.resize(ch.size());
+        heapPos.resize(ch.size());
+        for (size_t c = 0; c < ch.size(); ++c) {
+            ch[c].rate = rateOf(ch[c]);
+            ch[c].tau = ch[c].rate > 0 ? now + exponential() / ch[c].rate : INF;
+            heap[c] = {ch[c].tau, (int)c};
+            heapPos[c] = (int)c;
+        }
+        for (size_t i = heap.size() / 2; i-- > 0;) siftDown(i);
+    }
+
+    // Fires every event due before `until` (at most maxEvents). When `links` is
+    // given, formed/broken bonds are applied to it. Returns the events fired.
+    size_t advance(double until, std::vector<Link>* links, size_t maxEvents) {
+        size_t fired = 0;
+        while (!heap.empty() && fired < maxEvents) {
+            if (heap[0].tau > until) break;
+            int c = heap[0].channel;
+            now = heap[0].tau;
+            fire(c, links);
+            ++fired;
+        }
+        if (fired < maxEvents) now = until;
+        return fired;
+    }
+
+private:
+    struct Channel {
+        int a, b;         // atom indices
+        double formRate;  // formation rate while both atoms have free valence
+        double breakRate;
+        double rate, tau;
+        bool linked;
+        int linkSlot;     // index in the Links vector while linked
+    };
+    struct HeapNode { double tau; int channel; }; // tau copied in so sifting stays in one array
+    static constexpr double INF = 1e300;
+
+    static uint64_t pairKey(int a, int b) {
+        if (a > b) std::swap(a, b);
+        return (uint64_t)(uint32_t)a << 32 | (uint32_t)b;
+    }
+
+    double exponential() { return -std::log((rng.next() + 0.5) * (1.0 / 4294967296.0)); }
+
+    double rateOf(const Channel& c) const {
+        if (c.linked) return c.breakRate;
+        if (degree[c.a] >= valence[c.a] || degree[c.b] >= valence[c.b]) return 0.0;
+        return c.formRate;
+    }
+
+    void fire(int c, std::vector<Link>* links) {
+        Channel& f = ch[c];
+        int delta = f.linked ? -1 : 1;
+        if (links) {
+            if (onBond) onBond(ids[f.a], ids[f.b], !f.linked);
+            if (f.linked) {
+                int slot = f.linkSlot, last = (int)links->size() - 1;
+                (*links)[slot] = (*links)[last];
+                linkChannel[slot] = linkChannel[last];
+                if (linkChannel[slot] >= 0) ch[linkChannel[slot]].linkSlot = slot;
+                links->pop_back();
+                linkChannel.pop_back();
+                f.linkSlot = -1;
+            } else {
+                links->push_back({std::min(ids[f.a], ids[f.b]), std::max(ids[f.a], ids[f.b])});
+                linkChannel.push_back(c);
+                f.linkSlot = (int)links->size() - 1;
+            }
+        }
+        f.linked = !f.linked;
+        degree[f.a] += delta;
+        degree[f.b] += delta;
+
+        f.rate = rateOf(f);
+        setTau(c, f.rate > 0 ? now + exponential() / f.rate : INF);
+
+        // Dependents: every other channel on either atom. Gibson-Bruck reuses
+        // the old putative time by rescaling instead of drawing a new variate.
+        for (int atom : {f.a, f.b}) {
+            for (int k = depStart[atom]; k < depStart[atom + 1]; ++k) {
+                int d = deps[k];
+                if (d == c) continue;
+                Channel& g = ch[d];
+                double r = rateOf(g);
+                if (r == g.rate) continue;
+                double tau;
+                if (r <= 0) tau = INF;
+                else if (g.rate > 0 && g.tau < INF) tau = now + (g.rate / r) * (g.tau - now);
+                else tau = now + exponential() / r;
+                g.rate = r;
+                setTau(d, tau);
+            }
+        }
+    }
+
+    void setTau(int c, double tau) {
+        double old = ch[c].tau;
+        ch[c].tau = tau;
+        if (tau == old) return;
+        size_t i = heapPos[c];
+        heap[i].tau = tau;
+        if (tau < old) siftUp(i);
+        else siftDown(i);
+    }
+    void place(size_t i, const HeapNode& node) {
+        heap[i] = node;
+        heapPos[node.channel] = (int)i;
+    }
+    void siftUp(size_t i) {
+        HeapNode node = heap[i];
+        while (i > 0) {
+            size_t parent = (i - 1) / 2;
+            if (heap[parent].tau <= node.tau) break;
+            place(i, heap[parent]);
+            i = parent;
+        }
+        place(i, node);
+    }
+    void siftDown(size_t i) {
+        HeapNode node = heap[i];
+        size_t n = heap.size();
+        for (;;) {
+            size_t l = 2 * i + 1, m = l;
+            if (l >= n) break;
+            if (l + 1 < n && heap[l + 1].tau < heap[l].tau) m = l + 1;
+            if (heap[m].tau >= node.tau) break;
+            place(i, heap[m]);
+            i = m;
+        }
+        place(i, node);
+    }
+
+    std::vector<Channel> ch;
+    std::vector<HeapNode> heap;
+    std::vector<int> heapPos;
+    std::vector<int> depStart, deps;            // CSR: channels sharing atom i
+    std::vector<int> order;                     // internal atom index -> scene index
+    std::vector<int> ids, element, valence, degree;
+    std::vector<int> linkChannel; // parallel to Links; -1 for links without a channel
+    SpatialGrid grid;
+    FastRng rng{12345u};
+    double now = 0.0;
+};
+
+// ---- Spin models on the link graph ----
+
+// splitmix64 finalizer: a stateless hash, so parallel sweeps can draw
+// "random" numbers from (seed, sweep, site) without sharing RNG state.
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+inline double hashUniform(uint64_t a, uint64_t b, uint64_t c) {
+    return (mix64(a * 0x9e3779b97f4a7c15ull ^ mix64(b * 0xc2b2ae3d27d4eb4full ^ c)) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// q-state Potts model (q = 2 is Ising) with atoms as sites and links as
+// bonds: E = -J * sum over links of delta(s_a, s_b). Spin 1 is "active".
+// Metropolis sweeps go colour class by colour class of a greedy graph
+// colouring; sites of one colour share no link, so each class is updated in
+// parallel. Wolff grows one cluster at a time; Swendsen-Wang activates bonds
+// in parallel and merges them with a lock-free union-find. Per-state counts
+// and the energy are updated from the flips' deltas.
+class SpinModel {
+public:
+    enum Algorithm { Metropolis, Wolff, SwendsenWang };
+
+    int q = 2;
+    double J = 1.0;
+    double temperature = 1.5;
+
+    size_t size() const { return spin.size(); }
+    int spinOf(size_t i) const { return spin[i]; }
+    double energy() const { return bondEnergy; }
+
+    // Order parameter in [0, 1]: fraction in the majority state, rescaled so
+    // a uniformly random configuration gives 0.
+    double magnetization() const {
+        if (spin.empty()) return 0.0;
+        long top = *std::max_element(counts.begin(), counts.end());
+        return (q * (double)top / spin.size() - 1.0) / (q - 1);
+    }
+
+    void build(const AtomStore& atoms, const std::vector<Link>& links) {
+        size_t n = atoms.size();
+        std::unordered_map<int, int> indexOf;
+        spin.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            indexOf[atoms[i].id] = (int)i;
+            spin[i] = atoms[i].active ? 1 : 0;
+        }
+        adjStart.assign(n + 1, 0);
+        edges.clear();
+        for (const auto& L : links) {
+            auto a = indexOf.find(L.aId), b = indexOf.find(L.bId);
+            if (a == indexOf.end() || b == indexOf.end()) continue;
+            edges.push_back({a->second, b->second});
+            ++adjStart[a->second + 1];
+            ++adjStart[b->second + 1];
+        }
+        for (size_t i = 0; i < n; ++i) adjStart[i + 1] += adjStart[i];
+        adj.resize(adjStart[n]);
+        std::vector<int> fill(adjStart.begin(), adjStart.end() - 1);
+        for (const auto& e : edges) { adj[fill[e.first]++] = e.second; adj[fill[e.second]++] = e.first; }
+
+        // Greedy colouring, highest degree first
+        std::vector<int> byDegree(n), color(n, -1);
+        for (size_t i = 0; i < n; ++i) byDegree[i] = (int)i;
+        std::sort(byDegree.begin(), byDegree.end(), [&](int a, int b){ return degreeOf(a) > degreeOf(b); });
+        int colors = 0;
+        std::vector<char> used;
+        for (int v : byDegree) {
+            used.assign(colors + 1, 0);
+            for (int k = adjStart[v]; k < adjStart[v + 1]; ++k) if (color[adj[k]] >= 0) used[color[adj[k]]] = 1;
+            int c = 0;
+            while (used[c]) ++c;
+            color[v] = c;
+            colors = std::max(colors, c + 1);
+        }
+        colorStart.assign(colors + 1, 0);
+        for (int c : color) ++colorStart[c + 1];
+        for (int c = 0; c < colors; ++c) colorStart[c + 1] += colorStart[c];
+        colorItems.resize(n);
+        std::vector<int> cfill(colorStart.begin(), colorStart.end() - 1);
+        for (size_t i = 0; i < n; ++i) colorItems[cfill[color[i]]++] = (int)i;
+
+        recount();
+    }
+
+    void sweep(Algorithm algo) {
+        ++sweepIndex;
+        if (spin.empty()) return;
+        if (algo == Metropolis) metropolisSweep();
+        else if (algo == Wolff) wolffSweep();
+        else swendsenWangSweep();
+    }
+
+private:
+    int degreeOf(int v) const { return adjStart[v + 1] - adjStart[v]; }
+
+    void recount() {
+        counts.assign(q, 0);
+        for (int s : spin) ++counts[s];
+        bondEnergy = 0.0;
+        for (const auto& e : edges) if (spin[e.first] == spin[e.second]) bondEnergy -= J;
+    }
+
+    void metropolisSweep() {
+        double beta = 1.0 / std::max(temperature, 1e-6);
+        std::mutex m;
+        for (size_t c = 0; c + 1 < colorStart.size(); ++c) {
+            workerPool().parallelFor(colorStart[c + 1] - colorStart[c], 2048, [&](size_t b, size_t e){
+                std::vector<long> dCounts(q, 0);
+                double dE = 0.0;
+                for (size_t k = b; k < e; ++k) {
+                    int v = colorItems[colorStart[c] + k];
+                    int old = spin[v];
+                    int proposal = (old + 1 + (int)(hashUniform(seed, sweepIndex, 2 * v) * (q - 1))) % q;
+                    int same = 0, sameNew = 0;
+                    for (int a = adjStart[v]; a < adjStart[v + 1]; ++a) {
+                        same += spin[adj[a]] == old;
+                        sameNew += spin[adj[a]] == proposal;
+                    }
+                    double delta = -J * (sameNew - same);
+                    if (delta <= 0 || hashUniform(seed, sweepIndex, 2 * v + 1) < std::exp(-beta * delta)) {
+                        spin[v] = proposal;
+                        --dCounts[old];
+                        ++dCounts[proposal];
+                        dE += delta;
+                    }
+                }
+                std::lock_guard<std::mutex> lk(m);
+                for (int s = 0; s < q; ++s) counts[s] += dCounts[s];
+                bondEnergy += dE;
+            });
+        }
+    }
+
+    // Clusters until about one site per site has been flipped.
+    void wolffSweep() {
+        double pAdd = 1.0 - std::exp(-J / std::max(temperature, 1e-6));
+        inCluster.assign(spin.size(), 0);
+        size_t flipped = 0;
+        for (int round = 0; flipped < spin.size() && round < 1000; ++round) {
+            int start = (int)(rng.next() % spin.size());
+            int from = spin[start];
+            int to = (from + 1 + (int)(rng.next() % (q - 1))) % q;
+            cluster.clear();
+            cluster.push_back(start);
+            inCluster[start] = 1;
+            for (size_t head = 0; head < cluster.size(); ++head) {
+                int v = cluster[head];
+                for (int a = adjStart[v]; a < adjStart[v + 1]; ++a) {
+                    int u = adj[a];
+                    if (!inCluster[u] && spin[u] == from && rng.uniform() < pAdd) {
+                        inCluster[u] = 1;
+                        cluster.push_back(u);
+                    }
+                }
+            }
+            // Only bonds crossing the cluster boundary change energy
+            double dE = 0.0;
+            for (int v : cluster) {
+                for (int a = adjStart[v]; a < adjStart[v + 1]; ++a) {
+                    int u = adj[a];
+                    if (inCluster[u]) continue;
+                    dE -= J * ((spin[u] == to) - (spin[u] == from));
+                }
+            }
+            for (int v : cluster) { spin[v] = to; inCluster[v] = 0; }
+            counts[from] -= (long)cluster.size();
+            counts[to] += (long)cluster.size();
+            bondEnergy += dE;
+            flipped += cluster.size();
+        }
+    }
+
+    int findRoot(int v) {
+        for (;;) {
+            int p = parent[v].load(std::memory_order_relaxed);
+            if (p == v) return v;
+            int gp = parent[p].load(std::memory_order_relaxed);
+            if (gp != p) parent[v].compare_exchange_weak(p, gp, std::memory_order_relaxed); // path halving
+            v = gp;
+        }
+    }
+
+    void unite(int a, int b) {
+        for (;;) {
+            a = findRoot(a);
+            b = findRoot(b);
+            if (a == b) return;
+            if (a < b) std::swap(a, b); // the larger index hangs under the smaller
+            int expected = a;
+            if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) return;
+        }
+    }
+
+    void swendsenWangSweep() {
+        size_t n = spin.size();
+        double pAdd = 1.0 - std::exp(-J / std::max(temperature, 1e-6));
+        if (parentSize != n) {
+            parent.reset(new std::atomic<int>[n]);
+            parentSize = n;
+        }
+        workerPool().parallelFor(n, 4096, [&](size_t b, size_t e){
+            for (size_t i = b; i < e; ++i) parent[i].store((int)i, std::memory_order_relaxed);
+        });
+        workerPool().parallelFor(edges.size(), 4096, [&](size_t b, size_t e){
+            for (size_t k = b; k < e; ++k) {
+                auto [u, v] = edges[k];
+                if (spin[u] == spin[v] && hashUniform(seed, sweepIndex, k) < pAdd) unite(u, v);
+            }
+        });
+        // Every cluster takes a fresh random state, chosen by its root
+        workerPool().parallelFor(n, 4096, [&](size_t b, size_t e){
+            for (size_t i = b; i < e; ++i) {
+                int root = findRoot((int)i);
+                spin[i] = (int)(hashUniform(seed ^ 0x5151, sweepIndex, root) * q);
+            }
+        });
+        recount(); // every site was relabelled, so a full recount costs no more than deltas would
+    }
+
+    std::vector<int> spin;
+    std::vector<int> adjStart, adj;
+    std::vector<std::pair<int, int>> edges;
+    std::vector<int> colorStart, colorItems;
+    std::vector<long> counts;
+    double bondEnergy = 0.0;
+    std::vector<char> inCluster;
+    std::vector<int> cluster;
+    std::unique_ptr<std::atomic<int>[]> parent;
+    size_t parentSize = 0;
+    uint64_t seed = 0x1234567ull, sweepIndex = 0;
+    FastRng rng{99u};
+};
+
+// ---- Optical Bloch equations ----
+
+// Each atom as a driven two-level system in the rotating frame, Bloch vector
+// (u, v, w) with w = P_excited - P_ground:
+//   u' = delta v - u / T2
+//   v' = -delta u + Omega w - v / T2
+//   w' = -Omega v - (w + 1) / T1
+// State is SoA, indexed like the atoms vector and padded to whole batches of
+// LANES atoms; RK4 runs over fixed-width batches with no branches or
+// remainder loops, which the compiler vectorizes across atoms (-O3, or -O2
+// with -fvect-cost-model=dynamic). Active atoms are driven
+// continuously; pulse() adds a timed drive of given area on top.
+class BlochEngine {
+public:
+    float rabi = 2.f * 3.14159265f * 0.5f; // Omega, rad/s: one full Rabi cycle every 2 s
+    float detuning = 0.f;                  // delta, rad/s
+    float t1 = 4.f, t2 = 3.f;              // relaxation and dephasing times, s
+
+    static constexpr size_t LANES = 8;
+
+    size_t size() const { return ids.size(); }
+    float excited(size_t i) const { return 0.5f * (1.f + w[i]); }
+    float phase(size_t i) const { return std::atan2(v[i], u[i]); }
+
+    // Re-index after an edit, carrying over the state of atoms that survived
+    void build(const AtomStore& atoms) {
+        std::unordered_map<int, size_t> previous;
+        previous.reserve(ids.size());
+        for (size_t i = 0; i < ids.size(); ++i) previous[ids[i]] = i;
+        size_t n = atoms.size(), padded = (n + LANES - 1) / LANES * LANES;
+        std::vector<int> newIds(n);
+        std::vector<float> nu(padded, 0.f), nv(padded, 0.f), nw(padded, -1.f), npulse(padded, 0.f);
+        cw.assign(padded, 0.f);
+        for (size_t i = 0; i < n; ++i) {
+            newIds[i] = atoms[i].id;
+            cw[i] = atoms[i].active ? 1.f : 0.f;
+            auto it = previous.find(atoms[i].id);
+            if (it == previous.end()) continue;
+            nu[i] = u[it->second]; nv[i] = v[it->second]; nw[i] = w[it->second];
+            npulse[i] = pulseLeft[it->second];
+        }
+        ids.swap(newIds);
+        u.swap(nu); v.swap(nv); w.swap(nw);
+        pulseLeft.swap(npulse);
+        omega.assign(padded, 0.f);
+    }
+
+    // Continuous drive follows the atoms' current active states. Spin flips
+    // change those without an edit, so this runs every step, not just on build.
+    void syncDrive(const AtomStore& atoms) {
+        for (size_t i = 0; i < atoms.size() && i < cw.size(); ++i) cw[i] = atoms[i].active ? 1.f : 0.f;
+    }
+
+    // Timed drive of the given area (pi flips ground to excited)
+    void pulse(size_t i, float area) { pulseLeft[i] += area / rabi; }
+
+    void step(float dt, int substeps = 2) {
+        float h = dt / substeps;
+        workerPool().parallelFor(u.size() / LANES, 1024, [&](size_t b, size_t e){
+            // Pulses end mid-frame, so scale the last frame's drive to keep the area exact
+            for (size_t i = b * LANES; i < e * LANES; ++i) {
+                float p = std::min(pulseLeft[i], dt);
+                omega[i] = rabi * std::min(1.f, cw[i] + p / dt);
+                pulseLeft[i] -= p;
+            }
+            for (size_t batch = b; batch < e; ++batch)
+                for (int s = 0; s < substeps; ++s) rk4(batch * LANES, h);
+        });
+    }
+
+private:
+    void rk4(size_t first, float h) {
+        float* __restrict U = u.data() + first;
+        float* __restrict V = v.data() + first;
+        float* __restrict W = w.data() + first;
+        const float* __restrict O = omega.data() + first;
+        const float d = detuning, g1 = 1.f / t1, g2 = 1.f / t2;
+        for (size_t i = 0; i < LANES; ++i) {
+            float x = U[i], y = V[i], z = W[i], o = O[i];
+            float ku1 = d * y - g2 * x,                 kv1 = -d * x + o * z - g2 * y,                 kw1 = -o * y - g1 * (z + 1.f);
+            float x2 = x + 0.5f * h * ku1, y2 = y + 0.5f * h * kv1, z2 = z + 0.5f * h * kw1;
+            float ku2 = d * y2 - g2 * x2,               kv2 = -d * x2 + o * z2 - g2 * y2,              kw2 = -o * y2 - g1 * (z2 + 1.f);
+            float x3 = x + 0.5f * h * ku2, y3 = y + 0.5f * h * kv2, z3 = z + 0.5f * h * kw2;
+            float ku3 = d * y3 - g2 * x3,               kv3 = -d * x3 + o * z3 - g2 * y3,              kw3 = -o * y3 - g1 * (z3 + 1.f);
+            float x4 = x + h * ku3, y4 = y + h * kv3, z4 = z + h * kw3;
+            float ku4 = d * y4 - g2 * x4,               kv4 = -d * x4 + o * z4 - g2 * y4,              kw4 = -o * y4 - g1 * (z4 + 1.f);
+            U[i] = x + h / 6.f * (ku1 + 2.f * ku2 + 2.f * ku3 + ku4);
+            V[i] = y + h / 6.f * (kv1 + 2.f * kv2 + 2.f * kv3 + kv4);
+            W[i] = z + h / 6.f * (kw1 + 2.f * kw2 + 2.f * kw3 + kw4);
+        }
+    }
+
+    std::vector<int> ids;
+    std::vector<float> u, v, w;
+    std::vector<float> cw;        // 1 while the atom is active (continuous drive)
+    std::vector<float> pulseLeft; // seconds of pulsed drive still to apply
+    std::vector<float> omega;     // this frame's Rabi frequency
+};
+
+// ---- Structure analysis ----
+
+struct StructureResult {
+    std::vector<float> r, g; // bin centres (px) and g(r)
+    std::vector<float> k, s; // |k| bin centres (rad/px) and S(k)
+    size_t atoms = 0;
+};
+
+// Pair correlation and structure factor of a position snapshot inside box.
+// g(r) counts pairs through the spatial grid with one histogram per worker
+// chunk, merged at the end, and divides by the pair count uniform points in
+// the same rectangle would give (its isotropic covariogram), so the open
+// edges don't bias it low. S(k) = |rho_k|^2 / N from a cloud-in-cell density
+// grid and a 2D FFT, divided by the CIC window's aliased sum (so uncorrelated
+// points give 1 right up to Nyquist) and averaged over shells of |k|.
+StructureResult analyzeStructure(const std::vector<sf::Vector2f>& pos, sf::FloatRect box, float rMax, int bins) {
+    StructureResult out;
+    size_t n = pos.size();
+    out.atoms = n;
+    float w = box.width, h = box.height, area = w * h;
+    rMax = std::min(rMax, 0.5f * std::min(w, h));
+    if (n < 2 || rMax <= 0.f) return out;
+
+    float dr = rMax / bins;
+    SpatialGrid grid;
+    grid.build(pos, std::max(rMax / 2.f, 8.f));
+    std::vector<double> hist(bins, 0.0);
+    std::mutex merge;
+    workerPool().parallelFor(n, 512, [&](size_t b, size_t e){
+        std::vector<uint32_t> local(bins, 0);
+        for (size_t i = b; i < e; ++i) {
+            grid.forEachNear(pos[i], rMax, [&](int j){
+                if ((size_t)j <= i) return;
+                float dx = pos[j].x - pos[i].x, dy = pos[j].y - pos[i].y;
+                float d = std::sqrt(dx * dx + dy * dy);
+                if (d < rMax) ++local[std::min((int)(d / dr), bins - 1)]; // d / dr can round up to bins
+            });
+        }
+        std::lock_guard<std::mutex> lk(merge);
+        for (int k = 0; k < bins; ++k) hist[k] += local[k];
+    });
+    double pairs = 0.5 * (double)n * (n - 1);
+    for (int k = 0; k < bins; ++k) {
+        double rc = (k + 0.5) * dr;
+        double covariogram = area - 2.0 * rc * (w + h) / PI_D + rc * rc / PI_D;
+        double ideal = pairs * 2.0 * PI_D * rc * dr * covariogram / ((double)area * area);
+        out.r.push_back((float)rc);
+        out.g.push_back(ideal > 0.0 ? (float)(hist[k] / ideal) : 0.f);
+    }
+
+    const size_t M = 256;
+    float side = std::max(w, h), cellPx = side / M;
+    std::vector<cfloat> rho(M * M, cfloat(0.f, 0.f)), scratch(M * M);
+    for (const auto& p : pos) {
+        float fx = (p.x - box.left) / cellPx - 0.5f, fy = (p.y - box.top) / cellPx - 0.5f;
+        int x0 = (int)std::floor(fx), y0 = (int)std::floor(fy);
+        float tx = fx - x0, ty = fy - y0;
+        for (int dy = 0; dy < 2; ++dy)
+            for (int dx = 0; dx < 2; ++dx) {
+                size_t cx = (size_t)((x0 + dx + (int)M) % (int)M), cy = (size_t)((y0 + dy + (int)M) % (int)M);
+                rho[cy * M + cx] += (dx ? tx : 1.f - tx) * (dy ? ty : 1.f - ty);
+            }
+    }
+    FFTPlan plan(M);
+    fft2dTransposed(rho, scratch, plan, false); // |rho_k| doesn't care about the transpose
+    size_t shells = M / 2;
+    std::vector<double> sum(shells, 0.0);
+    std::vector<int> count(shells, 0);
+    for (size_t i = 0; i < M; ++i) {
+        for (size_t j = 0; j < M; ++j) {
+            int fi = i < M / 2 ? (int)i : (int)i - (int)M, fj = j < M / 2 ? (int)j : (int)j - (int)M;
+            size_t shell = (size_t)std::lround(std::sqrt((double)(fi * fi + fj * fj)));
+            if (shell == 0 || shell >= shells) continue;
+            double sx = std::sin(PI_D * fi / M), sy = std::sin(PI_D * fj / M);
+            double window = (1.0 - 2.0 / 3.0 * sx * sx) * (1.0 - 2.0 / 3.0 * sy * sy);
+            sum[shell] += std::norm(rho[i * M + j]) / window;
+            ++count[shell];
+        }
+    }
+    float dk = 2.f * 3.14159265f / side;
+    for (size_t q = 1; q < shells; ++q) {
+        out.k.push_back(q * dk);
+        out.s.push_back(count[q] ? (float)(sum[q] / count[q] / n) : 0.f);
+    }
+    return out;
+}
+
+bool exportStructureCsv(const StructureResult& res, const std::string& path) {
+    std::ofstream f(path);
+    if (!f) return false;
+    f << "r_px,g_r,k_rad_per_px,S_k\n";
+    for (size_t i = 0; i < std::max(res.r.size(), res.k.size()); ++i) {
+        if (i < res.r.size()) f << res.r[i] << ',' << res.g[i];
+        else f << ',';
+        f << ',';
+        if (i < res.k.size()) f << res.k[i] << ',' << res.s[i];
+        else f << ',';
+        f << '\n';
+    }
+    return (bool)f;
+}
+
+// One small line plot per curve, stacked in area; the y axis runs 0..max.
+void drawStructurePlots(sf::RenderWindow& window, const sf::Font& font, const StructureResult& res, sf::FloatRect area) {
+    struct Curve { const char* name; const std::vector<float>* x; const std::vector<float>* y; };
+    Curve curves[] = { {"g(r)", &res.r, &res.g}, {"S(k)", &res.k, &res.s} };
+    float plotH = area.height / 2.f - 6.f;
+    for (int c = 0; c < 2; ++c) {
+        sf::FloatRect plot(area.left, area.top + c * (plotH + 12.f), area.width, plotH);
+        sf::RectangleShape frame({plot.width, plot.height});
+        frame.setPosition(plot.left, plot.top);
+        frame.setFillColor(sf::Color(16, 16, 22));
+        frame.setOutlineThickness(1.f);
+        frame.setOutlineColor(sf::Color(60, 60, 75));
+        window.draw(frame);
+        const auto& xs = *curves[c].x;
+        const auto& ys = *curves[c].y;
+        if (ys.empty()) continue;
+        float yMax = std::max(1.f, *std::max_element(ys.begin(), ys.end()));
+        float xMax = xs.back();
+        // Reference line at 1, the uncorrelated value of both
+        sf::Vertex one[2] = {
+            sf::Vertex({plot.left, plot.top + plot.height * (1.f - 1.f / yMax)}, sf::Color(80, 80, 100)),
+            sf::Vertex({plot.left + plot.width, plot.top + plot.height * (1.f - 1.f / yMax)}, sf::Color(80, 80, 100)) };
+        window.draw(one, 2, sf::Lines);
+        sf::VertexArray line(sf::LineStrip, ys.size());
+        for (size_t i = 0; i < ys.size(); ++i) {
+            line[i].position = { plot.left + plot.width * xs[i] / xMax, plot.top + plot.height * (1.f - ys[i] / yMax) };
+            line[i].color = c == 0 ? sf::Color(120, 200, 255) : sf::Color(255, 180, 120);
+        }
+        window.draw(line);
+        if (font.getInfo().family != "") {
+            char label[64];
+            std::snprintf(label, sizeof label, "%s  max %.2f", curves[c].name, yMax);
+            window.draw(makeText(label, font, 12, sf::Color(200, 200, 210), {plot.left + 4.f, plot.top + 2.f}));
+        }
+    }
+}
+
+// ---- Thermal motion and diffusion ----
+
+float standardAtomicMass(int atomicNumber) {
+    switch (atomicNumber) {
+    case 1: return 1.008f;
+    case 2: return 4.003f;
+    case 3: return 6.94f;
+    case 4: return 9.012f;
+    case 5: return 10.81f;
+    case 6: return 12.011f;
+    case 7: return 14.007f;
+    case 8: return 15.999f;
+    case 11: return 22.990f;
+    case 17: return 35.45f;
+    default: return 2.f * atomicNumber;
+    }
+}
+
+// Overdamped Langevin (Brownian) motion in a periodic box. Positions are SoA
+// with atoms grouped by element, so per-element consumers see contiguous
+// ranges; classStart[e]..classStart[e+1] are the slots of ELEMENTS[e].
+class ThermalMotion {
+public:
+    float diffusionScale = 400.f; // px^2/s for a 1 u atom; D falls as 1/sqrt(mass)
+
+    std::vector<float> x, y;       // wrapped into box
+    std::vector<int> order;        // slot -> atom index
+    std::vector<int> classStart;
+    sf::FloatRect box;
+
+    float diffusionOf(int elementIndex) const {
+        return diffusionScale / std::sqrt(standardAtomicMass(ELEMENTS[elementIndex].atomicNumber));
+    }
+
+    void build(const AtomStore& atoms, sf::FloatRect area) {
+        box = area;
+        size_t n = atoms.size();
+        classStart.assign(ELEMENTS.size() + 1, 0);
+        for (const auto& a : atoms) ++classStart[a.elementIndex + 1];
+        for (size_t e = 0; e < ELEMENTS.size(); ++e) classStart[e + 1] += classStart[e];
+        order.resize(n);
+        std::vector<int> fill(classStart.begin(), classStart.end() - 1);
+        for (size_t i = 0; i < n; ++i) order[fill[atoms[i].elementIndex]++] = (int)i;
+        x.resize(n); y.resize(n); sigma.resize(n);
+        for (size_t k = 0; k < n; ++k) {
+            AtomView a = atoms[order[k]];
+            x[k] = wrap(a.pos.x, box.left, box.width);
+            y[k] = wrap(a.pos.y, box.top, box.height);
+            sigma[k] = std::sqrt(2.f * diffusionOf(a.elementIndex));
+        }
+    }
+
+    void step(float dt) {
+        ++stepIndex;
+        float root = std::sqrt(dt);
+        workerPool().parallelFor(x.size(), 4096, [&](size_t b, size_t e){
+            for (size_t k = b; k < e; ++k) {
+                // Box-Muller from the stateless hash, so chunks need no RNG of their own
+                double u1 = hashUniform(stepIndex, k, 0) + 1e-12, u2 = hashUniform(stepIndex, k, 1);
+                double r = std::sqrt(-2.0 * std::log(u1));
+                float gx = (float)(r * std::cos(2.0 * PI_D * u2)), gy = (float)(r * std::sin(2.0 * PI_D * u2));
+                x[k] = wrap(x[k] + sigma[k] * root * gx, box.left, box.width);
+                y[k] = wrap(y[k] + sigma[k] * root * gy, box.top, box.height);
+            }
+        });
+    }
+
+    void writeBack(AtomStore& atoms) const {
+        for (size_t k = 0; k < order.size(); ++k) atoms[order[k]].pos = {x[k], y[k]};
+    }
+
+private:
+    static float wrap(float v, float lo, float span) {
+        v -= lo;
+        v -= span * std::floor(v / span);
+        return lo + v;
+    }
+
+    std::vector<float> sigma; // sqrt(2 D) per slot
+    uint64_t stepIndex = 0;
+};
+
+// Streaming mean-squared displacement per atom class with a multi-tau
+// correlator: level l keeps the last POINTS positions sampled every
+// AVERAGE^l steps and correlates lags j * AVERAGE^l against the newest one.
+// Forwarding the newest position (rather than a block mean) is the
+// displacement form of block-averaging the velocity, so every lag is exact.
+// Each step costs O(POINTS) per atom amortized and memory is fixed, however
+// long the run. Input is wrapped SoA positions; displacements between feeds
+// are unwrapped by minimum image.
+class MsdCorrelator {
+public:
+    static constexpr int LEVELS = 12, POINTS = 16, AVERAGE = 2;
+    static constexpr size_t LANES = 8;
+
+    struct Point { double tau, msd; };
+
+    void reset(const std::vector<int>& classBounds, sf::FloatRect area, const float* x, const float* y, size_t count, float step) {
+        classStart = classBounds;
+        box = area;
+        n = count;
+        dt = step;
+        prevX.assign(x, x + n); prevY.assign(y, y + n);
+        unX = prevX; unY = prevY;
+        for (int l = 0; l < LEVELS; ++l) {
+            bufX[l].assign((size_t)POINTS * n, 0.f);
+            bufY[l].assign((size_t)POINTS * n, 0.f);
+            head[l] = filled[l] = pushes[l] = 0;
+        }
+        size_t classes = classStart.size() - 1;
+        sums.assign((size_t)LEVELS * POINTS * classes, 0.0);
+        samples.assign((size_t)LEVELS * POINTS, 0);
+        push(0);
+    }
+
+    void feed(const float* x, const float* y) {
+        if (n == 0) return;
+        float w = box.width, h = box.height;
+        for (size_t i = 0; i < n; ++i) {
+            float dx = x[i] - prevX[i], dy = y[i] - prevY[i];
+            dx -= w * std::floor(dx / w + 0.5f);
+            dy -= h * std::floor(dy / h + 0.5f);
+            unX[i] += dx; unY[i] += dy;
+            prevX[i] = x[i]; prevY[i] = y[i];
+        }
+        push(0);
+    }
+
+    std::vector<Point> curve(size_t cls) const {
+        std::vector<Point> out;
+        size_t classes = classStart.size() - 1, members = classStart[cls + 1] - classStart[cls];
+        if (members == 0) return out;
+        for (int l = 0; l < LEVELS; ++l)
+            for (int j = firstLag(l); j < POINTS; ++j) {
+                size_t slot = (size_t)l * POINTS + j;
+                if (samples[slot] == 0) continue;
+                out.push_back({ j * std::pow((double)AVERAGE, l) * dt, sums[slot * classes + cls] / ((double)samples[slot] * members) });
+            }
+        return out;
+    }
+
+    // D from a least-squares line MSD = a + 4 D tau over the longest decade of lags
+    double diffusion(size_t cls) const {
+        auto pts = curve(cls);
+        if (pts.size() < 3) return 0.0;
+        double tauMax = pts.back().tau, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        int m = 0;
+        for (const auto& p : pts) {
+            if (p.tau < tauMax / 10.0) continue;
+            sx += p.tau; sy += p.msd; sxx += p.tau * p.tau; sxy += p.tau * p.msd; ++m;
+        }
+        double den = m * sxx - sx * sx;
+        return (m >= 2 && den > 0.0) ? (m * sxy - sx * sy) / den / 4.0 : 0.0;
+    }
+
+private:
+    static int firstLag(int level) { return level == 0 ? 1 : POINTS / AVERAGE; }
+
+    void push(int level) {
+        float* bx = bufX[level].data() + (size_t)head[level] * n;
+        float* by = bufY[level].data() + (size_t)head[level] * n;
+        std::copy(unX.begin(), unX.end(), bx);
+        std::copy(unY.begin(), unY.end(), by);
+        filled[level] = std::min(filled[level] + 1, POINTS);
+        size_t classes = classStart.size() - 1;
+        int lags = filled[level] - firstLag(level);
+        if (lags > 0) {
+            workerPool().parallelFor((size_t)lags, 1, [&](size_t b, size_t e){
+                for (size_t t = b; t < e; ++t) {
+                    int j = firstLag(level) + (int)t;
+                    int slot = (head[level] - j + POINTS) % POINTS;
+                    const float* ox = bufX[level].data() + (size_t)slot * n;
+                    const float* oy = bufY[level].data() + (size_t)slot * n;
+                    size_t sumSlot = (size_t)level * POINTS + j;
+                    for (size_t c = 0; c < classes; ++c)
+                        sums[sumSlot * classes + c] += squaredDisplacement(bx, by, ox, oy, classStart[c], classStart[c + 1]);
+                    ++samples[sumSlot];
+                }
+            });
+        }
+        head[level] = (head[level] + 1) % POINTS;
+        if (++pushes[level] % AVERAGE == 0 && level + 1 < LEVELS) push(level + 1);
+    }
+
+    // Sum over [b, e) with LANES independent accumulators, so the loop
+    // vectorizes without reassociating a single float sum.
+    static double squaredDisplacement(const float* ax, const float* ay, const float* bx, const float* by, size_t b, size_t e) {
+        float lane[LANES] = {};
+        size_t i = b;
+        for (; i + LANES <= e; i += LANES)
+            for (size_t k = 0; k < LANES; ++k) {
+                float dx = ax[i + k] - bx[i + k], dy = ay[i + k] - by[i + k];
+                lane[k] += dx * dx + dy * dy;
+            }
+        double total = 0.0;
+        for (size_t k = 0; k < LANES; ++k) total += lane[k];
+        for (; i < e; ++i) {
+            float dx = ax[i] - bx[i], dy = ay[i] - by[i];
+            total += dx * dx + dy * dy;
+        }
+        return total;
+    }
+
+    std::vector<int> classStart;
+    sf::FloatRect box;
+    size_t n = 0;
+    float dt = 1.f;
+    std::vector<float> prevX, prevY, unX, unY;
+    std::vector<float> bufX[LEVELS], bufY[LEVELS];
+    int head[LEVELS] = {}, filled[LEVELS] = {};
+    long pushes[LEVELS] = {};
+    std::vector<double> sums;  // [level][lag][class]
+    std::vector<long> samples; // [level][lag]
+};
+
+// ---- Software rasterizer ----
+
+// Classic 5x7 bitmap font for ASCII 32..126: one byte per column, bit 0 at the top.
+static const uint8_t FONT_5X7[95][5] = {
+    {0x00,0x00,0x00,0x00,0x00},
+    {0x00,0x00,0x5F,0x00,0x00},
+    {0x00,0x07,0x00,0x07,0x00},
+    {0x14,0x7F,0x14,0x7F,0x14},
+    {0x24,0x2A,0x7F,0x2A,0x12},
+    {0x23,0x13,0x08,0x64,0x62},
+    {0x36,0x49,0x55,0x22,0x50},
+    {0x00,0x05,0x03,0x00,0x00},
+    {0x00,0x1C,0x22,0x41,0x00},
+    {0x00,0x41,0x22,0x1C,0x00},
+    {0x14,0x08,0x3E,0x08,0x14},
+    {0x08,0x08,0x3E,0x08,0x08},
+    {0x00,0x50,0x30,0x00,0x00},
+    {0x08,0x08,0x08,0x08,0x08},
+    {0x00,0x60,0x60,0x00,0x00},
+    {0x20,0x10,0x08,0x04,0x02},
+    {0x3E,0x51,0x49,0x45,0x3E},
+    {0x00,0x42,0x7F,0x40,0x00},
+    {0x42,0x61,0x51,0x49,0x46},
+    {0x21,0x41,0x45,0x4B,0x31},
+    {0x18,0x14,0x12,0x7F,0x10},
+    {0x27,0x45,0x45,0x45,0x39},
+    {0x3C,0x4A,0x49,0x49,0x30},
+    {0x01,0x71,0x09,0x05,0x03},
+    {0x36,0x49,0x49,0x49,0x36},
+    {0x06,0x49,0x49,0x29,0x1E},
+    {0x00,0x36,0x36,0x00,0x00},
+    {0x00,0x56,0x36,0x00,0x00},
+    {0x08,0x14,0x22,0x41,0x00},
+    {0x14,0x14,0x14,0x14,0x14},
+    {0x00,0x41,0x22,0x14,0x08},
+    {0x02,0x01,0x51,0x09,0x06},
+    {0x32,0x49,0x79,0x41,0x3E},
+    {0x7E,0x11,0x11,0x11,0x7E},
+    {0x7F,0x49,0x49,0x49,0x36},
+    {0x3E,0x41,0x41,0x41,0x22},
+    {0x7F,0x41,0x41,0x22,0x1C},
+    {0x7F,0x49,0x49,0x49,0x41},
+    {0x7F,0x09,0x09,0x09,0x01},
+    {0x3E,0x41,0x49,0x49,0x7A},
+    {0x7F,0x08,0x08,0x08,0x7F},
+    {0x00,0x41,0x7F,0x41,0x00},
+    {0x20,0x40,0x41,0x3F,0x01},
+    {0x7F,0x08,0x14,0x22,0x41},
+    {0x7F,0x40,0x40,0x40,0x40},
+    {0x7F,0x02,0x0C,0x02,0x7F},
+    {0x7F,0x04,0x08,0x10,0x7F},
+    {0x3E,0x41,0x41,0x41,0x3E},
+    {0x7F,0x09,0x09,0x09,0x06},
+    {0x3E,0x41,0x51,0x21,0x5E},
+    {0x7F,0x09,0x19,0x29,0x46},
+    {0x46,0x49,0x49,0x49,0x31},
+    {0x01,0x01,0x7F,0x01,0x01},
+    {0x3F,0x40,0x40,0x40,0x3F},
+    {0x1F,0x20,0x40,0x20,0x1F},
+    {0x3F,0x40,0x38,0x40,0x3F},
+    {0x63,0x14,0x08,0x14,0x63},
+    {0x07,0x08,0x70,0x08,0x07},
+    {0x61,0x51,0x49,0x45,0x43},
+    {0x00,0x7F,0x41,0x41,0x00},
+    {0x02,0x04,0x08,0x10,0x20},
+    {0x00,0x41,0x41,0x7F,0x00},
+    {0x04,0x02,0x01,0x02,0x04},
+    {0x40,0x40,0x40,0x40,0x40},
+    {0x00,0x01,0x02,0x04,0x00},
+    {0x20,0x54,0x54,0x54,0x78},
+    {0x7F,0x48,0x44,0x44,0x38},
+    {0x38,0x44,0x44,0x44,0x20},
+    {0x38,0x44,0x44,0x48,0x7F},
+    {0x38,0x54,0x54,0x54,0x18},
+    {0x08,0x7E,0x09,0x01,0x02},
+    {0x0C,0x52,0x52,0x52,0x3E},
+    {0x7F,0x08,0x04,0x04,0x78},
+    {0x00,0x44,0x7D,0x40,0x00},
+    {0x20,0x40,0x44,0x3D,0x00},
+    {0x7F,0x10,0x28,0x44,0x00},
+    {0x00,0x41,0x7F,0x40,0x00},
+    {0x7C,0x04,0x18,0x04,0x78},
+    {0x7C,0x08,0x04,0x04,0x78},
+    {0x38,0x44,0x44,0x44,0x38},
+    {0x7C,0x14,0x14,0x14,0x08},
+    {0x08,0x14,0x14,0x18,0x7C},
+    {0x7C,0x08,0x04,0x04,0x08},
+    {0x48,0x54,0x54,0x54,0x20},
+    {0x04,0x3F,0x44,0x40,0x20},
+    {0x3C,0x40,0x40,0x20,0x7C},
+    {0x1C,0x20,0x40,0x20,0x1C},
+    {0x3C,0x40,0x30,0x40,0x3C},
+    {0x44,0x28,0x10,0x28,0x44},
+    {0x0C,0x50,0x50,0x50,0x3C},
+    {0x44,0x64,0x54,0x4C,0x44},
+    {0x00,0x08,0x36,0x41,0x00},
+    {0x00,0x00,0x7F,0x00,0x00},
+    {0x00,0x41,0x36,0x08,0x00},
+    {0x08,0x04,0x08,0x10,0x08}
+};
+
+// Framebuffer pixels are RGBA8 packed with R in the low byte, the byte order
+// image files and sf::Image use; the framebuffer is always opaque.
+inline uint32_t packColor(sf::Color c) { return c.r | c.g << 8 | c.b << 16 | (uint32_t)c.a << 24; }
+
+// Blends a constant colour over a span at weight alpha (0..256). Red and blue
+// share one 32-bit multiply, green takes another; no branches, so the loop
+// vectorizes. Opaque spans are a plain fill.
+inline void blendSpan(uint32_t* dst, int count, uint32_t color, uint32_t alpha) {
+    if (count <= 0) return;
+    if (alpha >= 256) { std::fill_n(dst, count, color | 0xFF000000u); return; }
+    uint32_t srb = (color & 0xFF00FFu) * alpha, sg = (color & 0x00FF00u) * alpha, inv = 256 - alpha;
+    for (int i = 0; i < count; ++i) {
+        uint32_t d = dst[i];
+        uint32_t rb = (((d & 0xFF00FFu) * inv + srb) >> 8) & 0xFF00FFu;
+        uint32_t g = (((d & 0x00FF00u) * inv + sg) >> 8) & 0x00FF00u;
+        dst[i] = rb | g | 0xFF000000u;
+    }
+}
+
+// Single-pixel form for anti-aliased rims and glyphs, alpha 0..256
+inline void blendPixel(uint32_t& d, uint32_t color, uint32_t alpha) {
+    uint32_t inv = 256 - alpha;
+    uint32_t rb = (((d & 0xFF00FFu) * inv + (color & 0xFF00FFu) * alpha) >> 8) & 0xFF00FFu;
+    uint32_t g = (((d & 0x00FF00u) * inv + (color & 0x00FF00u) * alpha) >> 8) & 0x00FF00u;
+    d = rb | g | 0xFF000000u;
+}
+
+// Pre-rasterized coverage masks for one pixel size: the 5x7 bitmap scaled by
+// size / 10 with 4x4 supersampling, all glyphs side by side in one strip.
+struct GlyphAtlas {
+    int glyphW = 0, glyphH = 0, stride = 0, advance = 0, top = 0;
+    std::vector<uint8_t> coverage;
+
+    explicit GlyphAtlas(unsigned size = 14) {
+        float scale = size / 10.f;
+        glyphW = (int)std::ceil(5 * scale);
+        glyphH = (int)std::ceil(7 * scale);
+        advance = (int)std::lround(6 * scale);
+        top = (int)std::lround(0.3f * size); // sf::Text's cap line sits about this far below its origin
+        stride = glyphW * 95;
+        coverage.assign((size_t)stride * glyphH, 0);
+        for (int g = 0; g < 95; ++g)
+            for (int y = 0; y < glyphH; ++y)
+                for (int x = 0; x < glyphW; ++x) {
+                    int hits = 0;
+                    for (int sy = 0; sy < 4; ++sy)
+                        for (int sx = 0; sx < 4; ++sx) {
+                            int col = (int)((x + (sx + 0.5f) / 4.f) / scale), row = (int)((y + (sy + 0.5f) / 4.f) / scale);
+                            if (col < 5 && row < 7 && (FONT_5X7[g][col] >> row & 1)) ++hits;
+                        }
+                    coverage[(size_t)y * stride + g * glyphW + x] = (uint8_t)(hits * 255 / 16);
+                }
+    }
+};
+
+// CPU render backend for when there is no GL context (headless nodes, CI).
+// Draw calls only record commands; finish() bins them into TILE x TILE tiles
+// and rasterizes the tiles in parallel, each tile replaying its commands in
+// submission order so blending matches the GPU path. Shapes fill row spans:
+// fully covered runs go through blendSpan, and only the one-pixel rim is
+// anti-aliased from the analytic distance.
+class SoftwareRenderer {
+public:
+    static const int TILE = 64;
+
+    int width = 0, height = 0;
+    std::vector<uint32_t> pixels;
+
+    void begin(int w, int h, sf::Color background) {
+        if (w != width || h != height) {
+            width = w; height = h;
+            pixels.assign((size_t)w * h, 0);
+        }
+        clearColor = packColor(background);
+        commands.clear();
+    }
+
+    void rect(sf::FloatRect r, sf::Color c) {
+        Command cmd = shape(Command::Rect, c, r.left, r.top, r.left + r.width, r.top + r.height);
+        cmd.p[0] = r.left; cmd.p[1] = r.top; cmd.p[2] = r.left + r.width; cmd.p[3] = r.top + r.height;
+        push(cmd);
+    }
+
+    // Outline outside the rectangle, as sf::RectangleShape draws it
+    void rectOutline(sf::FloatRect r, float t, sf::Color c) {
+        rect({r.left - t, r.top - t, r.width + 2 * t, t}, c);
+        rect({r.left - t, r.top + r.height, r.width + 2 * t, t}, c);
+        rect({r.left - t, r.top, t, r.height}, c);
+        rect({r.left + r.width, r.top, t, r.height}, c);
+    }
+
+    void disk(sf::Vector2f center, float radius, sf::Color c) {
+        Command cmd = shape(Command::Disk, c, center.x - radius - 1, center.y - radius - 1, center.x + radius + 1, center.y + radius + 1);
+        cmd.p[0] = center.x; cmd.p[1] = center.y; cmd.p[2] = radius;
+        push(cmd);
+    }
+
+    void ring(sf::Vector2f center, float inner, float outer, sf::Color c) {
+        Command cmd = shape(Command::Ring, c, center.x - outer - 1, center.y - outer - 1, center.x + outer + 1, center.y + outer + 1);
+        cmd.p[0] = center.x; cmd.p[1] = center.y; cmd.p[2] = inner; cmd.p[3] = outer;
+        push(cmd);
+    }
+
+    void line(sf::Vector2f a, sf::Vector2f b, float thickness, sf::Color c) {
+        float reach = 0.5f * thickness + 1.f;
+        Command cmd = shape(Command::Line, c, std::min(a.x, b.x) - reach, std::min(a.y, b.y) - reach,
+                            std::max(a.x, b.x) + reach, std::max(a.y, b.y) + reach);
+        cmd.p[0] = a.x; cmd.p[1] = a.y; cmd.p[2] = b.x; cmd.p[3] = b.y; cmd.p[4] = 0.5f * thickness;
+        push(cmd);
+    }
+
+    // Same origin convention as sf::Text::setPosition
+    void text(std::string_view str, sf::Vector2f pos, unsigned size, sf::Color c) {
+        const GlyphAtlas& atlas = atlasFor(size);
+        float x = std::round(pos.x);
+        for (char ch : str) {
+            int g = (unsigned char)ch - 32;
+            if (g > 0 && g < 95) {
+                Command cmd = shape(Command::Glyph, c, x, std::round(pos.y) + atlas.top, x + atlas.glyphW, std::round(pos.y) + atlas.top + atlas.glyphH);
+                cmd.mask = atlas.coverage.data() + g * atlas.glyphW;
+                cmd.maskStride = atlas.stride;
+                cmd.maskX = (int)x; cmd.maskY = (int)std::round(pos.y) + atlas.top;
+                push(cmd);
+            }
+            x += atlas.advance;
+        }
+    }
+
+    void finish() {
+        int tilesX = (width + TILE - 1) / TILE, tilesY = (height + TILE - 1) / TILE;
+        bins.resize((size_t)tilesX * tilesY);
+        for (auto& b : bins) b.clear();
+        for (size_t i = 0; i < commands.size(); ++i) {
+            const Command& c = commands[i];
+            for (int ty = c.y0 / TILE; ty <= (c.y1 - 1) / TILE; ++ty)
+                for (int tx = c.x0 / TILE; tx <= (c.x1 - 1) / TILE; ++tx)
+                    if (touchesTile(c, tx * TILE, ty * TILE)) bins[(size_t)ty * tilesX + tx].push_back((uint32_t)i);
+        }
+        // Clearing whole rows streams memory; clearing tile by tile is ~4x slower
+        workerPool().parallelFor((size_t)height, 64, [&](size_t b, size_t e){
+            std::fill(pixels.begin() + b * width, pixels.begin() + e * width, clearColor | 0xFF000000u);
+        });
+        workerPool().parallelFor(bins.size(), 1, [&](size_t b, size_t e){
+            for (size_t t = b; t < e; ++t) {
+                int tx0 = (int)(t % tilesX) * TILE, ty0 = (int)(t / tilesX) * TILE;
+                int tx1 = std::min(tx0 + TILE, width), ty1 = std::min(ty0 + TILE, height);
+                for (uint32_t ci : bins[t]) raster(commands[ci], tx0, ty0, tx1, ty1);
+            }
+        });
+    }
+
+private:
+    struct Command {
+        enum Kind : uint8_t { Rect, Disk, Ring, Line, Glyph } kind;
+        uint32_t color;
+        float p[5];
+        int x0, y0, x1, y1; // pixel bounds, max exclusive, clipped to the framebuffer
+        const uint8_t* mask = nullptr;
+        int maskStride = 0, maskX = 0, maskY = 0;
+    };
+
+    Command shape(Command::Kind kind, sf::Color c, float x0, float y0, float x1, float y1) const {
+        Command cmd;
+        cmd.kind = kind;
+        cmd.color = packColor(c);
+        cmd.x0 = std::max(0, (int)std::floor(x0));
+        cmd.y0 = std::max(0, (int)std::floor(y0));
+        cmd.x1 = std::min(width, (int)std::ceil(x1));
+        cmd.y1 = std::min(height, (int)std::ceil(y1));
+        return cmd;
+    }
+
+    void push(const Command& cmd) {
+        if (cmd.x0 < cmd.x1 && cmd.y0 < cmd.y1 && (cmd.color >> 24)) commands.push_back(cmd);
+    }
+
+    // Circles only reach the tiles their rim or interior crosses; a big
+    // electron ring's bounding box is mostly hole.
+    static bool touchesTile(const Command& c, int tx, int ty) {
+        if (c.kind != Command::Disk && c.kind != Command::Ring) return true;
+        float cx = c.p[0], cy = c.p[1];
+        float outer = (c.kind == Command::Disk ? c.p[2] : c.p[3]) + 1.f;
+        float nx = std::clamp(cx, (float)tx, (float)(tx + TILE)) - cx, ny = std::clamp(cy, (float)ty, (float)(ty + TILE)) - cy;
+        if (nx * nx + ny * ny > outer * outer) return false;
+        if (c.kind == Command::Disk) return true;
+        float fx = std::max(std::fabs(tx - cx), std::fabs(tx + TILE - cx)), fy = std::max(std::fabs(ty - cy), std::fabs(ty + TILE - cy));
+        float inner = c.p[2] - 1.f;
+        return inner <= 0.f || fx * fx + fy * fy > inner * inner;
+    }
+
+    const GlyphAtlas& atlasFor(unsigned size) {
+        auto it = atlases.find(size);
+        if (it == atlases.end()) it = atlases.emplace(size, GlyphAtlas(size)).first;
+        return it->second;
+    }
+
+    // Runs [x0, x1) of row y, clipped to the tile, through per-pixel coverage
+    template <class Coverage>
+    void rimSpan(uint32_t* row, int x0, int x1, int cx0, int cx1, uint32_t color, Coverage&& cov) {
+        float weight = (color >> 24) * (256.f / 255.f);
+        for (int x = std::max(x0, cx0); x < std::min(x1, cx1); ++x) {
+            float c = cov(x + 0.5f);
+            if (c > 0.f) blendPixel(row[x], color, (uint32_t)(weight * std::min(c, 1.f) + 0.5f));
+        }
+    }
+
+    void raster(const Command& c, int tx0, int ty0, int tx1, int ty1) {
+        int x0 = std::max(c.x0, tx0), x1 = std::min(c.x1, tx1), y0 = std::max(c.y0, ty0), y1 = std::min(c.y1, ty1);
+        if (x0 >= x1 || y0 >= y1) return;
+        uint32_t alpha = ((c.color >> 24) * 256 + 127) / 255;
+        switch (c.kind) {
+        case Command::Rect: {
+            // Rect edges snap to whole pixels, as SFML's do at integer positions
+            int rx0 = std::max(x0, (int)std::lround(c.p[0])), rx1 = std::min(x1, (int)std::lround(c.p[2]));
+            int ry0 = std::max(y0, (int)std::lround(c.p[1])), ry1 = std::min(y1, (int)std::lround(c.p[3]));
+            for (int y = ry0; y < ry1; ++y) blendSpan(&pixels[(size_t)y * width + rx0], rx1 - rx0, c.color, alpha);
+            break;
+        }
+        case Command::Disk:
+        case Command::Ring: {
+            float cx = c.p[0], cy = c.p[1];
+            float outer = c.kind == Command::Disk ? c.p[2] : c.p[3], inner = c.kind == Command::Disk ? -1.f : c.p[2];
+            for (int y = y0; y < y1; ++y) {
+                uint32_t* row = &pixels[(size_t)y * width];
+                float dy = y + 0.5f - cy;
+                float o2 = (outer + 0.5f) * (outer + 0.5f) - dy * dy;
+                if (o2 <= 0.f) continue;
+                float ho = std::sqrt(o2);
+                int xo0 = (int)std::floor(cx - ho), xo1 = (int)std::ceil(cx + ho);
+                if (xo1 <= x0 || xo0 >= x1) continue;
+                // Rim pixels are within a pixel of a circle of radius R, where the
+                // distance to it is (d^2 - R^2) / 2R to first order: no sqrt
+                float outerK = 0.5f / std::max(outer, 1.f), innerK = 0.5f / std::max(inner, 1.f);
+                auto cov = [&](float px){
+                    float d2 = (px - cx) * (px - cx) + dy * dy;
+                    float in = 0.5f - (d2 - outer * outer) * outerK;
+                    return inner < 0.f ? in : std::min(in, 0.5f + (d2 - inner * inner) * innerK);
+                };
+                if (c.kind == Command::Disk) {
+                    // Solid run where the whole pixel is inside, rims on either side
+                    float i2 = (outer - 0.5f) * (outer - 0.5f) - dy * dy;
+                    if (i2 <= 0.f) { rimSpan(row, xo0, xo1, x0, x1, c.color, cov); continue; }
+                    float hi = std::sqrt(i2);
+                    int xi0 = (int)std::ceil(cx - hi - 0.5f), xi1 = (int)std::floor(cx + hi - 0.5f) + 1;
+                    rimSpan(row, xo0, xi0, x0, x1, c.color, cov);
+                    int s0 = std::max(xi0, x0), s1 = std::min(xi1, x1);
+                    blendSpan(row + s0, s1 - s0, c.color, alpha);
+                    rimSpan(row, xi1, xo1, x0, x1, c.color, cov);
+                } else {
+                    // Skip the hole: pixels entirely inside the inner radius
+                    float h2 = (inner - 0.5f) * (inner - 0.5f) - dy * dy;
+                    if (inner <= 0.5f || h2 <= 0.f) { rimSpan(row, xo0, xo1, x0, x1, c.color, cov); continue; }
+                    float hh = std::sqrt(h2);
+                    int xh0 = (int)std::ceil(cx - hh - 0.5f), xh1 = (int)std::floor(cx + hh - 0.5f) + 1;
+                    rimSpan(row, xo0, xh0, x0, x1, c.color, cov);
+                    rimSpan(row, xh1, xo1, x0, x1, c.color, cov);
+                }
+            }
+            break;
+        }
+        case Command::Line: {
+            float ax = c.p[0], ay = c.p[1], dx = c.p[2] - ax, dy = c.p[3] - ay, hw = c.p[4];
+            float len2 = dx * dx + dy * dy, reach = hw + 0.5f;
+            for (int y = y0; y < y1; ++y) {
+                uint32_t* row = &pixels[(size_t)y * width];
+                float py = y + 0.5f;
+                // Parameter range of the segment within reach of this row, then its x extent
+                float t0 = 0.f, t1 = 1.f;
+                if (std::fabs(dy) > 1e-6f) {
+                    float ta = (py - reach - ay) / dy, tb = (py + reach - ay) / dy;
+                    t0 = std::max(0.f, std::min(ta, tb));
+                    t1 = std::min(1.f, std::max(ta, tb));
+                    if (t0 > t1) continue;
+                }
+                float xa = ax + dx * t0, xb = ax + dx * t1;
+                int sx0 = (int)std::floor(std::min(xa, xb) - reach), sx1 = (int)std::ceil(std::max(xa, xb) + reach);
+                rimSpan(row, sx0, sx1, x0, x1, c.color, [&](float px){
+                    float t = len2 > 0.f ? std::clamp(((px - ax) * dx + (py - ay) * dy) / len2, 0.f, 1.f) : 0.f;
+                    float ex = ax + dx * t - px, ey = ay + dy * t - py;
+                    return reach - std::sqrt(ex * ex + ey * ey);
+                });
+            }
+            break;
+        }
+        case Command::Glyph:
+            for (int y = y0; y < y1; ++y) {
+                const uint8_t* m = c.mask + (size_t)(y - c.maskY) * c.maskStride;
+                uint32_t* row = &pixels[(size_t)y * width];
+                for (int x = x0; x < x1; ++x) {
+                    uint8_t v = m[x - c.maskX];
+                    if (v) blendPixel(row[x], c.color, (alpha * v + 127) / 255);
+                }
+            }
+            break;
+        }
+    }
+
+    uint32_t clearColor = 0;
+    std::vector<Command> commands;
+    std::vector<std::vector<uint32_t>> bins; // command indices per tile
+    std::unordered_map<unsigned, GlyphAtlas> atlases;
+};
+
+// ---- Frame export ----
+
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t n) {
+    static const std::vector<uint32_t> table = [](){
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t adler32(const uint8_t* data, size_t n) {
+    uint32_t a = 1, b = 0;
+    while (n > 0) {
+        size_t block = std::min(n, (size_t)5552); // largest run without overflowing before the modulo
+        for (size_t i = 0; i < block; ++i) { a += data[i]; b += a; }
+        a %= 65521; b %= 65521;
+        data += block; n -= block;
+    }
+    return b << 16 | a;
+}
+
+// Common prefix length of a and b, up to limit, eight bytes at a time
+inline size_t matchLength(const uint8_t* a, const uint8_t* b, size_t limit) {
+    size_t len = 0;
+    while (len + 8 <= limit) {
+        uint64_t x, y;
+        std::memcpy(&x, a + len, 8);
+        std::memcpy(&y, b + len, 8);
+        if (x != y) break;
+        len += 8;
+    }
+    while (len < limit && a[len] == b[len]) ++len;
+    return len;
+}
+
+// zlib stream with one fixed-Huffman deflate block. LZ77 matches come from
+// 3-byte hash chains over a 32 KiB window, with a short chain limit: UI
+// frames are mostly long flat runs, which the first candidate already finds.
+std::vector<uint8_t> zlibCompress(const uint8_t* data, size_t n) {
+    static const uint16_t LEN_BASE[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+    static const uint8_t LEN_EXTRA[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+    static const uint16_t DIST_BASE[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+    static const uint8_t DIST_EXTRA[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+    const int WINDOW = 32768, HASH_BITS = 15, MAX_CHAIN = 8, MAX_MATCH = 258;
+
+    std::vector<uint8_t> out;
+    out.reserve(n / 4 + 64);
+    out.push_back(0x78); out.push_back(0x01);
+    uint64_t bits = 0;
+    int count = 0;
+    auto put = [&](uint32_t value, int len){ // LSB first
+        bits |= (uint64_t)value << count;
+        count += len;
+        while (count >= 8) { out.push_back((uint8_t)bits); bits >>= 8; count -= 8; }
+    };
+    // Fixed literal/length and distance codes, bit-reversed once since
+    // Huffman codes go out MSB first
+    struct Code { uint16_t bits; uint8_t len; };
+    static const std::vector<Code> FIXED = [](){
+        std::vector<Code> t(288 + 30);
+        auto reversed = [](uint32_t code, int len){
+            uint32_t rev = 0;
+            for (int i = 0; i < len; ++i) rev |= ((code >> i) & 1) << (len - 1 - i);
+            return Code{(uint16_t)rev, (uint8_t)len};
+        };
+        for (int sym = 0; sym < 288; ++sym) {
+            if (sym < 144) t[sym] = reversed(0x30 + sym, 8);
+            else if (sym < 256) t[sym] = reversed(0x190 + sym - 144, 9);
+            else if (sym < 280) t[sym] = reversed(sym - 256, 7);
+            else t[sym] = reversed(0xC0 + sym - 280, 8);
+        }
+        for (int d = 0; d < 30; ++d) t[288 + d] = reversed(d, 5);
+        return t;
+    }();
+    auto literal = [&](int sym){ put(FIXED[sym].bits, FIXED[sym].len); };
+    put(1, 1); put(1, 2); // final block, fixed Huffman
+
+    std::vector<int32_t> head((size_t)1 << HASH_BITS, -1), prev(WINDOW, -1);
+    auto hashAt = [&](size_t i){ return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1u << HASH_BITS) - 1); };
+    auto insert = [&](size_t i){
+        uint32_t h = hashAt(i);
+        prev[i & (WINDOW - 1)] = head[h];
+        head[h] = (int32_t)i;
+    };
+    size_t i = 0;
+    while (i < n) {
+        int bestLen = 0, bestDist = 0;
+        if (i + 3 <= n) {
+            int32_t cand = head[hashAt(i)];
+            size_t limit = std::min((size_t)MAX_MATCH, n - i);
+            for (int chain = 0; cand >= 0 && (int)(i - cand) <= WINDOW && chain < MAX_CHAIN; ++chain) {
+                size_t len = matchLength(data + i, data + cand, limit);
+                if ((int)len > bestLen) { bestLen = (int)len; bestDist = (int)(i - cand); if (len == limit) break; }
+                int32_t next = prev[cand & (WINDOW - 1)];
+                if (next >= cand) break;
+                cand = next;
+            }
+        }
+        if (bestLen >= 3) {
+            int lc = 0;
+            while (lc < 28 && LEN_BASE[lc + 1] <= bestLen) ++lc;
+            literal(257 + lc);
+            put(bestLen - LEN_BASE[lc], LEN_EXTRA[lc]);
+            int dc = 0;
+            while (dc < 29 && DIST_BASE[dc + 1] <= bestDist) ++dc;
+            put(FIXED[288 + dc].bits, 5);
+            put(bestDist - DIST_BASE[dc], DIST_EXTRA[dc]);
+            // Long runs only seed the chains at their start; indexing every byte of them buys nothing
+            size_t seeded = std::min((size_t)bestLen, (size_t)16);
+            for (size_t k = 0; k < seeded && i + k + 3 <= n; ++k) insert(i + k);
+            i += bestLen;
+        } else {
+            if (i + 3 <= n) insert(i);
+            literal(data[i]);
+            ++i;
+        }
+    }
+    literal(256);
+    if (count > 0) put(0, 8 - count);
+    uint32_t adler = adler32(data, n);
+    for (int k = 3; k >= 0; --k) out.push_back((uint8_t)(adler >> (8 * k)));
+    return out;
+}
+
+// RGBA8 -> 8-bit RGB PNG. Each row takes whichever of the None/Sub/Up/Paeth
+// filters gives the smallest sum of absolute residuals.
+std::vector<uint8_t> encodePng(const uint8_t* rgba, int w, int h) {
+    size_t stride = (size_t)w * 3;
+    std::vector<uint8_t> rgb(stride * h);
+    for (size_t p = 0; p < (size_t)w * h; ++p) {
+        rgb[3 * p] = rgba[4 * p]; rgb[3 * p + 1] = rgba[4 * p + 1]; rgb[3 * p + 2] = rgba[4 * p + 2];
+    }
+    std::vector<uint8_t> filtered((stride + 1) * h);
+    std::vector<uint8_t> zeros(stride + 3, 0);
+    auto paeth = [](int a, int b, int c){
+        int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - 2 * c);
+        int ab = pa <= pb ? a : b, pab = std::min(pa, pb);
+        return pab <= pc ? ab : c;
+    };
+    auto cost = [](int v){ v &= 0xFF; return std::min(v, 256 - v); };
+    std::vector<uint8_t> left(stride + 3), upLeft(stride + 3);
+    for (int y = 0; y < h; ++y) {
+        const uint8_t* row = &rgb[y * stride];
+        const uint8_t* up = y > 0 ? &rgb[(y - 1) * stride] : zeros.data();
+        // Left neighbours with a zero pixel in front, so the loops have no edge case
+        std::fill_n(left.begin(), 3, 0); std::copy(row, row + stride - 3, left.begin() + 3);
+        std::fill_n(upLeft.begin(), 3, 0); std::copy(up, up + stride - 3, upLeft.begin() + 3);
+        const uint8_t* A = left.data();
+        const uint8_t* C = upLeft.data();
+        // Score all four filters in one pass, then write only the winner
+        long score[4] = {0, 0, 0, 0};
+        for (size_t x = 0; x < stride; ++x) {
+            score[0] += cost(row[x]);
+            score[1] += cost(row[x] - A[x]);
+            score[2] += cost(row[x] - up[x]);
+            score[3] += cost(row[x] - paeth(A[x], up[x], C[x]));
+        }
+        int best = (int)(std::min_element(score, score + 4) - score);
+        static const uint8_t FILTER_TYPE[4] = {0, 1, 2, 4};
+        uint8_t* dst = &filtered[y * (stride + 1)];
+        *dst++ = FILTER_TYPE[best];
+        switch (best) {
+        case 0: std::copy(row, row + stride, dst); break;
+        case 1: for (size_t x = 0; x < stride; ++x) dst[x] = (uint8_t)(row[x] - A[x]); break;
+        case 2: for (size_t x = 0; x < stride; ++x) dst[x] = (uint8_t)(row[x] - up[x]); break;
+        default: for (size_t x = 0; x < stride; ++x) dst[x] = (uint8_t)(row[x] - paeth(A[x], up[x], C[x])); break;
+        }
+    }
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    auto chunk = [&](const char* type, const std::vector<uint8_t>& body){
+        uint32_t len = (uint32_t)body.size();
+        for (int k = 3; k >= 0; --k) png.push_back((uint8_t)(len >> (8 * k)));
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), body.begin(), body.end());
+        uint32_t crc = crc32Update(0, &png[start], png.size() - start);
+        for (int k = 3; k >= 0; --k) png.push_back((uint8_t)(crc >> (8 * k)));
+    };
+    std::vector<uint8_t> ihdr;
+    for (uint32_t v : {(uint32_t)w, (uint32_t)h})
+        for (int k = 3; k >= 0; --k) ihdr.push_back((uint8_t)(v >> (8 * k)));
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0}); // 8-bit, truecolour, deflate, adaptive filters, no interlace
+    chunk("IHDR", ihdr);
+    chunk("IDAT", zlibCompress(filtered.data(), filtered.size()));
+    chunk("IEND", {});
+    return png;
+}
+
+bool writePng(const std::string& path, const uint8_t* rgba, int w, int h) {
+    std::vector<uint8_t> png = encodePng(rgba, w, h);
+    std::ofstream f(path, std::ios::binary);
+    f.write((const char*)png.data(), (std::streamsize)png.size());
+    return (bool)f;
+}
+
+// RGBA8 -> planar 4:2:0 (BT.601, limited range), the layout Y4M frames carry.
+void rgbaToI420(const uint8_t* rgba, int w, int h, std::vector<uint8_t>& out) {
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    out.resize((size_t)w * h + 2 * (size_t)cw * ch);
+    uint8_t* Y = out.data();
+    uint8_t* U = Y + (size_t)w * h;
+    uint8_t* V = U + (size_t)cw * ch;
+    for (int y = 0; y < h; ++y)
+        for (int x = 0; x < w; ++x) {
+            const uint8_t* p = rgba + 4 * ((size_t)y * w + x);
+            Y[(size_t)y * w + x] = (uint8_t)(((66 * p[0] + 129 * p[1] + 25 * p[2] + 128) >> 8) + 16);
+        }
+    for (int y = 0; y < ch; ++y)
+        for (int x = 0; x < cw; ++x) {
+            int r = 0, g = 0, b = 0, k = 0;
+            for (int dy = 0; dy < 2; ++dy)
+                for (int dx = 0; dx < 2; ++dx) {
+                    int sx = std::min(2 * x + dx, w - 1), sy = std::min(2 * y + dy, h - 1);
+                    const uint8_t* p = rgba + 4 * ((size_t)sy * w + sx);
+                    r += p[0]; g += p[1]; b += p[2]; ++k;
+                }
+            r /= k; g /= k; b /= k;
+            U[(size_t)y * cw + x] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            V[(size_t)y * cw + x] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+}
+
+// Records frames without stalling the caller. submit() copies the pixels into
+// one of queueFrames preallocated buffers and returns; encoder threads turn
+// them into numbered PNGs, or into one Y4M stream when the target ends in
+// .y4m or is "-" (stdout, for piping into an encoder). Y4M frames are
+// converted in parallel but written strictly in order. With every buffer in
+// flight, submit() either drops the frame or waits, per blockWhenFull.
+class FrameExporter {
+public:
+    struct Config {
+        std::string target = "capture_";
+        size_t queueFrames = 8;
+        unsigned threads = 0; // 0: half the hardware threads
+        bool blockWhenFull = false;
+    };
+
+    ~FrameExporter() { stop(); }
+
+    bool running() const { return !workers.empty(); }
+    long written() const { return framesWritten.load(); }
+    long dropped() const { return framesDropped.load(); }
+    const std::string& error() const { return lastError; }
+
+    bool start(const Config& cfg) {
+        stop();
+        config = cfg;
+        y4m = cfg.target == "-" || (cfg.target.size() > 4 && cfg.target.compare(cfg.target.size() - 4, 4, ".y4m") == 0);
+        if (y4m) {
+            out = cfg.target == "-" ? stdout : std::fopen(cfg.target.c_str(), "wb");
+            if (!out) { lastError = "cannot open " + cfg.target; return false; }
+        }
+        slots.assign(std::max<size_t>(1, cfg.queueFrames), Frame{});
+        freeSlots.clear();
+        for (size_t k = 0; k < slots.size(); ++k) freeSlots.push_back(k);
+        pending.clear();
+        nextIndex = nextWrite = 0;
+        framesWritten = framesDropped = 0;
+        stopping = false;
+        unsigned n = cfg.threads ? cfg.threads : std::max(1u, std::thread::hardware_concurrency() / 2);
+        for (unsigned k = 0; k < n; ++k) workers.emplace_back([this]{ encodeLoop(); });
+        return true;
+    }
+
+    // False when the frame was dropped
+    bool submit(const uint8_t* rgba, int w, int h) {
+        std::unique_lock<std::mutex> lk(m);
+        if (freeSlots.empty()) {
+            if (!config.blockWhenFull) { ++framesDropped; return false; }
+            slotFreed.wait(lk, [&]{ return !freeSlots.empty(); });
+        }
+        if (y4m && nextIndex == 0) { width = w; height = h; }
+        if (y4m && (w != width || h != height)) { ++framesDropped; return false; } // a Y4M stream has one size
+        size_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        Frame& f = slots[slot];
+        f.index = nextIndex++;
+        f.w = w; f.h = h;
+        lk.unlock();
+        f.rgba.assign(rgba, rgba + (size_t)w * h * 4); // the only per-frame work on the caller
+        lk.lock();
+        pending.push_back(slot);
+        frameReady.notify_one();
+        return true;
+    }
+
+    // Drains everything queued, then joins the encoders
+    void stop() {
+        if (workers.empty()) return;
+        {
+            std::lock_guard<std::mutex> lk(m);
+            stopping = true;
+        }
+        frameReady.notify_all();
+        for (auto& t : workers) t.join();
+        workers.clear();
+        if (out && out != stdout) std::fclose(out);
+        else if (out) std::fflush(out);
+        out = nullptr;
+    }
+
+private:
+    struct Frame { std::vector<uint8_t> rgba; int w = 0, h = 0; long index = 0; };
+
+    void encodeLoop() {
+        std::vector<uint8_t> yuv;
+        for (;;) {
+            size_t slot;
+            {
+                std::unique_lock<std::mutex> lk(m);
+                frameReady.wait(lk, [&]{ return stopping || !pending.empty(); });
+                if (pending.empty()) return;
+                slot = pending.front();
+                pending.pop_front();
+            }
+            Frame& f = slots[slot];
+            bool ok;
+            if (y4m) {
+                rgbaToI420(f.rgba.data(), f.w, f.h, yuv);
+                std::unique_lock<std::mutex> lk(writeMutex);
+                turn.wait(lk, [&]{ return nextWrite == f.index; });
+                if (f.index == 0) std::fprintf(out, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", f.w, f.h);
+                std::fputs("FRAME\n", out);
+                ok = std::fwrite(yuv.data(), 1, yuv.size(), out) == yuv.size();
+                ++nextWrite;
+                turn.notify_all();
+            } else {
+                char name[32];
+                std::snprintf(name, sizeof name, "%05ld.png", f.index);
+                ok = writePng(config.target + name, f.rgba.data(), f.w, f.h);
+            }
+            if (ok) ++framesWritten;
+            else { std::lock_guard<std::mutex> lk(m); lastError = "write failed"; }
+            std::lock_guard<std::mutex> lk(m);
+            freeSlots.push_back(slot);
+            slotFreed.notify_one();
+        }
+    }
+
+    Config config;
+    bool y4m = false;
+    std::FILE* out = nullptr;
+    int width = 0, height = 0;
+    std::vector<Frame> slots;
+    std::vector<size_t> freeSlots;
+    std::deque<size_t> pending;
+    long nextIndex = 0, nextWrite = 0;
+    bool stopping = false;
+    std::mutex m, writeMutex;
+    std::condition_variable frameReady, slotFreed, turn;
+    std::vector<std::thread> workers;
+    std::atomic<long> framesWritten{0}, framesDropped{0};
+    std::string lastError;
+};
+
+// ---- Shared-memory feed ----
+
+// Writes every simulation step into the ring laid out in QuantumSimShm.hpp.
+// Atoms are transposed straight into the slot's columns, the only copy the feed
+// makes. Links go out as the edits journaled since the previous step; the full
+// list goes out every keyframeInterval steps, after linksReset() and whenever the
+// journal overflows, so a reader that joins late or falls behind resyncs within
+// half a ring.
+class ShmPublisher {
+public:
+    ~ShmPublisher() { close(); }
+
+    bool isOpen() const { return base != nullptr; }
+    const std::string& error() const { return lastError; }
+
+    bool open(const std::string& feedName, uint32_t atomCapacity, uint32_t linkCapacity, uint32_t slots = 8) {
+        close();
+#ifdef QS_SHM_POSIX
+        name = shmObjectName(feedName);
+        layout = shmSlotLayout(atomCapacity, linkCapacity);
+        size_t first = (sizeof(ShmHeader) + 63) & ~(size_t)63;
+        bytes = first + layout.bytes * slots;
+        shm_unlink(name.c_str()); // left over from a run that crashed
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) { lastError = "cannot create " + name + ": " + std::strerror(errno); return false; }
+        if (ftruncate(fd, (off_t)bytes) != 0) {
+            lastError = "cannot size " + name + ": " + std::strerror(errno);
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) { lastError = "cannot map " + name; shm_unlink(name.c_str()); return false; }
+        base = (uint8_t*)p;
+        // The segment starts zeroed: published and every slot's seq are already 0
+        ShmHeader* h = header();
+        h->version = SHM_VERSION;
+        h->slotCount = slots;
+        h->atomCapacity = atomCapacity;
+        h->linkCapacity = linkCapacity;
+        h->keyframeInterval = std::max(1u, slots / 2);
+        h->slotBytes = layout.bytes;
+        h->firstSlot = first;
+        std::atomic_thread_fence(std::memory_order_release);
+        h->magic = SHM_MAGIC; // readers check it last
+        journal.clear();
+        journal.reserve(linkCapacity);
+        step = 0;
+        keyframeDue = true;
+        return true;
+#else
+        (void)feedName; (void)atomCapacity; (void)linkCapacity; (void)slots;
+        lastError = "shared memory needs a POSIX system";
+        return false;
+#endif
+    }
+
+    // Unlinks the name; readers that still have it mapped keep their view
+    void close() {
+#ifdef QS_SHM_POSIX
+        if (base) {
+            munmap(base, bytes);
+            shm_unlink(name.c_str());
+        }
+#endif
+        base = nullptr;
+    }
+
+    // A link edit since the last step; order 0 for a removal
+    void linkChanged(int aId, int bId, int order) {
+        if (!base) return;
+        // The slot's link region holds linkCapacity deltas; the vector's own capacity may be larger
+        if (journal.size() < header()->linkCapacity) journal.push_back({aId, bId, order});
+        else keyframeDue = true;
+    }
+
+    // Every link went at once (clear)
+    void linksReset() {
+        journal.clear();
+        keyframeDue = true;
+    }
+
+    // bloch may be null, or indexed differently from atoms while it is off
+    void publish(double time, const AtomStore& atoms, const std::vector<Link>& links, const BlochEngine* bloch) {
+        if (!base) return;
+        ShmHeader* h = header();
+        uint8_t* slot = base + h->firstSlot + (step % h->slotCount) * h->slotBytes;
+        ShmSlotHeader* sh = (ShmSlotHeader*)slot;
+        sh->seq.store(2 * step + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint32_t n = (uint32_t)std::min(atoms.size(), (size_t)h->atomCapacity);
+        int32_t* id = (int32_t*)(slot + layout.id);
+        float* x = (float*)(slot + layout.x);
+        float* y = (float*)(slot + layout.y);
+        float* excited = (float*)(slot + layout.excited);
+        float* phase = (float*)(slot + layout.phase);
+        uint8_t* flags = slot + layout.flags;
+        bool haveBloch = bloch && bloch->size() == atoms.size();
+        workerPool().parallelFor(n, 8192, [&](size_t b, size_t e){
+            for (size_t i = b; i < e; ++i) {
+                AtomView a = atoms[i];
+                id[i] = a.id;
+                x[i] = a.pos.x;
+                y[i] = a.pos.y;
+                excited[i] = haveBloch ? bloch->excited(i) : 0.f;
+                phase[i] = haveBloch ? bloch->phase(i) : 0.f;
+                flags[i] = (a.active ? SHM_ATOM_ACTIVE : 0) | (a.selected ? SHM_ATOM_SELECTED : 0);
+            }
+        });
+
+        uint32_t slotFlags = n < atoms.size() ? (uint32_t)SHM_TRUNCATED : 0u, m = 0;
+        ShmLinkDelta* delta = (ShmLinkDelta*)(slot + layout.links);
+        if (keyframeDue || step % h->keyframeInterval == 0) {
+            m = (uint32_t)std::min(links.size(), (size_t)h->linkCapacity);
+            for (uint32_t k = 0; k < m; ++k) delta[k] = {links[k].aId, links[k].bId, links[k].order};
+            slotFlags |= SHM_KEYFRAME | (m < links.size() ? (uint32_t)SHM_TRUNCATED : 0u);
+        } else {
+            m = (uint32_t)journal.size();
+            std::copy(journal.begin(), journal.end(), delta);
+        }
+        sh->step = step;
+        sh->time = time;
+        sh->atomCount = n;
+        sh->linkCount = (uint32_t)links.size();
+        sh->deltaCount = m;
+        sh->flags = slotFlags;
+
+        sh->seq.store(2 * step + 2, std::memory_order_release);
+        h->published.store(++step, std::memory_order_release);
+        journal.clear();
+        keyframeDue = false;
+    }
+
+private:
+    ShmHeader* header() const { return (ShmHeader*)base; }
+
+    std::string name, lastError;
+    uint8_t* base = nullptr;
+    size_t bytes = 0;
+    ShmSlotLayout layout{};
+    uint64_t step = 0;
+    std::vector<ShmLinkDelta> journal; // reserved to linkCapacity on open
+    bool keyframeDue = true;
+};
+
+// ---- Batched link rendering ----
+
+// Perpendicular offset of stroke s (0..order-1) of a double or triple bond
+inline float bondStrokeOffset(int order, int s, float spacing) {
+    return (s - 0.5f * (order - 1)) * spacing;
+}
+
+// Every link as anti-aliased quads in one vertex buffer, drawn with a single call.
+// Each link owns a fixed slot of order * VERTS_PER_STROKE vertices; per frame only
+// the links touching an atom that moved are rewritten. Any change to the atom ids or
+// the link list (edits, kinetics rewiring, bond orders) rebuilds the buffer.
+class LinkBatch {
+public:
+    static constexpr int VERTS_PER_STROKE = 18; // feather, core, feather: three quads as triangles
+    float width = 2.f;   // opaque core, px
+    float feather = 1.f; // alpha ramp on each side, px
+    float spacing = 4.f; // between the strokes of a multiple bond
+    sf::Color color = sf::Color(120, 200, 255);
+
+    void sync(const AtomStore& atoms, const std::vector<Link>& links) {
+        if (!sameTopology(atoms, links)) { build(atoms, links); return; }
+        bool any = false;
+        for (size_t i = 0; i < atoms.size(); ++i) {
+            dirty[i] = atoms[i].pos != lastPos[i];
+            if (dirty[i]) { lastPos[i] = atoms[i].pos; any = true; }
+        }
+        if (!any) return;
+        for (size_t i = 0; i < atoms.size(); ++i) {
+            if (!dirty[i]) continue;
+            for (int k = incidentStart[i]; k < incidentStart[i + 1]; ++k) {
+                int l = incident[k];
+                int other = endA[l] == (int)i ? endB[l] : endA[l];
+                if (dirty[other] && other < (int)i) continue; // already rewritten from that end
+                writeLink(l);
+            }
+        }
+    }
+
+    void draw(sf::RenderTarget& target) const {
+        if (!vertices.empty()) target.draw(vertices.data(), vertices.size(), sf::Triangles);
+    }
+
+private:
+    bool sameTopology(const AtomStore& atoms, const std::vector<Link>& links) const {
+        if (atoms.size() != ids.size() || links.size() != cachedLinks.size()) return false;
+        for (size_t i = 0; i < atoms.size(); ++i) if (atoms[i].id != ids[i]) return false;
+        for (size_t k = 0; k < links.size(); ++k) {
+            const Link& a = links[k];
+            const Link& b = cachedLinks[k];
+            if (a.aId != b.aId || a.bId != b.bId || a.order != b.order) return false;
+        }
+        return true;
+    }
+
+    void build(const AtomStore& atoms, const std::vector<Link>& links) {
+        size_t n = atoms.size(), m = links.size();
+        ids.resize(n);
+        lastPos.resize(n);
+        dirty.assign(n, 0);
+        std::unordered_map<int, int> indexOf;
+        for (size_t i = 0; i < n; ++i) {
+            ids[i] = atoms[i].id;
+            lastPos[i] = atoms[i].pos;
+            indexOf[atoms[i].id] = (int)i;
+        }
+        cachedLinks = links;
+        endA.assign(m, -1);
+        endB.assign(m, -1);
+        first.assign(m, -1);
+        incidentStart.assign(n + 1, 0);
+        size_t count = 0;
+        for (size_t k = 0; k < m; ++k) {
+            auto a = indexOf.find(links[k].aId), b = indexOf.find(links[k].bId);
+            if (a == indexOf.end() || b == indexOf.end()) continue;
+            endA[k] = a->second;
+            endB[k] = b->second;
+            first[k] = (int)count;
+            count += strokes(k) * VERTS_PER_STROKE;
+            ++incidentStart[endA[k] + 1];
+            ++incidentStart[endB[k] + 1];
+        }
+        for (size_t i = 0; i < n; ++i) incidentStart[i + 1] += incidentStart[i];
+        incident.resize(incidentStart[n]);
+        std::vector<int> fill(incidentStart.begin(), incidentStart.end() - 1);
+        for (size_t k = 0; k < m; ++k) {
+            if (first[k] < 0) continue;
+            incident[fill[endA[k]]++] = (int)k;
+            incident[fill[endB[k]]++] = (int)k;
+        }
+        vertices.resize(count);
+        for (size_t k = 0; k < m; ++k) writeLink((int)k);
+    }
+
+    int strokes(size_t k) const { return std::clamp(cachedLinks[k].order, 1, 3); }
+
+    void writeLink(int k) {
+        if (first[k] < 0) return;
+        sf::Vector2f a = lastPos[endA[k]], b = lastPos[endB[k]];
+        sf::Vector2f d = b - a;
+        float len = length(d);
+        sf::Vector2f n = len > 1e-4f ? sf::Vector2f(-d.y / len, d.x / len) : sf::Vector2f(0.f, 0.f);
+        sf::Color clear(color.r, color.g, color.b, 0);
+        const sf::Color band[4] = { clear, color, color, clear };
+        float h = 0.5f * width;
+        int order = strokes(k);
+        sf::Vertex* v = &vertices[first[k]];
+        for (int s = 0; s < order; ++s) {
+            float c = bondStrokeOffset(order, s, spacing);
+            const float edge[4] = { c - h - feather, c - h, c + h, c + h + feather };
+            for (int q = 0; q < 3; ++q) {
+                sf::Vector2f o0 = n * edge[q], o1 = n * edge[q + 1];
+                *v++ = sf::Vertex(a + o0, band[q]);
+                *v++ = sf::Vertex(b + o0, band[q]);
+                *v++ = sf::Vertex(b + o1, band[q + 1]);
+                *v++ = sf::Vertex(a + o0, band[q]);
+                *v++ = sf::Vertex(b + o1, band[q + 1]);
+                *v++ = sf::Vertex(a + o1, band[q + 1]);
+            }
+        }
+    }
+
+    std::vector<int> ids;                // atom ids at the last build
+    std::vector<Link> cachedLinks;
+    std::vector<sf::Vector2f> lastPos;   // positions the buffer was written with
+    std::vector<char> dirty;             // atom moved this sync
+    std::vector<int> endA, endB, first;  // per link: atom indices and first vertex (-1 if dangling)
+    std::vector<int> incidentStart, incident; // CSR: atom -> links
+    std::vector<sf::Vertex> vertices;
+};
+
+// ---- Nucleus sprite atlas ----
+
+// Nuclei and their symbols pre-rendered once, so all of them go out as textured
+// quads in one draw call. A body cell per (element, selected) holds the fill and
+// the black symbol; a rim cell per active state holds the outline in white. The
+// per-frame parts ride on vertex colours: the Bloch brightness multiplies the body
+// (the symbol stays black) and the rim is tinted with nucleusOutlineColor, so
+// photon flashes still show.
+class NucleusAtlas {
+public:
+    static constexpr int CELL = 48;
+    static constexpr int COLUMNS = 8;
+    static constexpr float RADIUS = 16.f; // nucleus radius the cells are drawn at
+
+    bool ready() const { return built; }
+
+    void build(const sf::Font& font) {
+        int cells = 2 * (int)ELEMENTS.size() + 2;
+        int rows = (cells + COLUMNS - 1) / COLUMNS;
+        texture.create(COLUMNS * CELL, rows * CELL);
+        texture.clear(sf::Color::Transparent);
+        bool haveFont = font.getInfo().family != "";
+        for (size_t el = 0; el < ELEMENTS.size(); ++el) {
+            for (int selected = 0; selected < 2; ++selected) {
+                sf::IntRect cell = bodyCell((int)el, selected);
+                sf::Vector2f center(cell.left + CELL * 0.5f, cell.top + CELL * 0.5f);
+                const sf::Color& c = ELEMENTS[el].color;
+                sf::CircleShape disk(RADIUS, 48);
+                disk.setOrigin(RADIUS, RADIUS);
+                disk.setPosition(center);
+                disk.setFillColor(sf::Color(c.r, c.g, c.b, selected ? 255 : 220));
+                texture.draw(disk, sf::BlendNone); // keep the fill's alpha as is
+                if (haveFont) texture.draw(makeText(ELEMENTS[el].symbol, font, 14, sf::Color::Black, {center.x - 8, center.y - 10}));
+            }
+        }
+        for (int active = 0; active < 2; ++active) {
+            sf::IntRect cell = rimCell(active);
+            sf::CircleShape rim(RADIUS, 48);
+            rim.setOrigin(RADIUS, RADIUS);
+            rim.setPosition(cell.left + CELL * 0.5f, cell.top + CELL * 0.5f);
+            rim.setFillColor(sf::Color::Transparent);
+            rim.setOutlineThickness(active ? 3.f : 1.f);
+            rim.setOutlineColor(sf::Color::White);
+            texture.draw(rim, sf::BlendNone);
+        }
+        texture.display();
+        texture.setSmooth(true);
+        built = true;
+    }
+
+    void begin() { vertices.clear(); }
+
+    void add(AtomView a, sf::Color bodyTint, sf::Color rimColor) {
+        float half = CELL * 0.5f * a.nucleusRadius / RADIUS;
+        quad(a.pos, half, bodyCell(a.elementIndex, a.selected), bodyTint);
+        quad(a.pos, half, rimCell(a.active), rimColor);
+    }
+
+    void draw(sf::RenderTarget& target) const {
+        if (vertices.empty()) return;
+        target.draw(vertices.data(), vertices.size(), sf::Quads, sf::RenderStates(&texture.getTexture()));
+    }
+
+private:
+    sf::IntRect cellRect(int index) const {
+        return sf::IntRect(index % COLUMNS * CELL, index / COLUMNS * CELL, CELL, CELL);
+    }
+    sf::IntRect bodyCell(int element, bool selected) const { return cellRect(2 * element + (selected ? 1 : 0)); }
+    sf::IntRect rimCell(bool active) const { return cellRect(2 * (int)ELEMENTS.size() + (active ? 1 : 0)); }
+
+    void quad(sf::Vector2f p, float half, sf::IntRect cell, sf::Color tint) {
+        float u0 = (float)cell.left, v0 = (float)cell.top, u1 = u0 + CELL, v1 = v0 + CELL;
+        vertices.push_back(sf::Vertex({p.x - half, p.y - half}, tint, {u0, v0}));
+        vertices.push_back(sf::Vertex({p.x + half, p.y - half}, tint, {u1, v0}));
+        vertices.push_back(sf::Vertex({p.x + half, p.y + half}, tint, {u1, v1}));
+        vertices.push_back(sf::Vertex({p.x - half, p.y + half}, tint, {u0, v1}));
+    }
+
+    sf::RenderTexture texture;
+    std::vector<sf::Vertex> vertices;
+    bool built = false;
+};
+
+// What the window shows, minus the GPU-only overlays (clouds, wavepacket,
+// photons, plots). The window fills it from live state, --headless from a
+// generated scene; buttons may be absent.
+struct SceneView {
+    const AtomStore* atoms = nullptr;
+    const std::vector<Link>* links = nullptr;
+    const std::vector<Button>* buttons = nullptr;
+    std::string title, status;
+    float titleY = 20.f, statusY = 48.f, listY = 100.f;
+    bool showRings = true;
 };
 
-struct Link {
-    int aId;
-    int bId;
+void rasterizeScene(SoftwareRenderer& r, const SceneView& v, int width, int height) {
+    r.begin(width, height, sf::Color(12, 12, 16));
+    r.rect({0.f, 0.f, SIDEBAR_W, (float)height}, sf::Color(22,22,30));
+    if (v.buttons) {
+        for (const auto& b : *v.buttons) {
+            sf::FloatRect box(b.box.getPosition(), b.box.getSize());
+            sf::Color fill = (b.toggled && *b.toggled) ? (b.hover ? sf::Color(70,90,120) : sf::Color(55,75,105))
+                                                       : (b.hover ? sf::Color(55,55,70) : sf::Color(40,40,50));
+            r.rect(box, fill);
+            r.rectOutline(box, 1.f, sf::Color(90,90,110));
+            r.text(b.label.getString().toAnsiString(), b.label.getPosition(), 16, sf::Color::White);
+        }
+    }
+    r.text(v.title, {16.f, v.titleY}, 18, sf::Color::White);
+    if (!v.status.empty()) r.text(v.status, {16.f, v.statusY}, 14, sf::Color(200,220,255));
+    r.text("Elements:", {16.f, v.listY - 24.f}, 16, sf::Color(220,220,220));
+    const auto& atoms = *v.atoms;
+    float yy = v.listY;
+    for (const auto& a : atoms) {
+        if (yy > height) break;
+        r.text(atomListRow(a), {16.f, yy}, 14, a.selected ? sf::Color(255,255,180) : sf::Color(200,200,210));
+        yy += 24.f;
+    }
+    if (v.links) {
+        std::unordered_map<int, sf::Vector2f> posOf;
+        for (const auto& a : atoms) posOf[a.id] = a.pos;
+        for (const auto& L : *v.links) {
+            auto A = posOf.find(L.aId), B = posOf.find(L.bId);
+            if (A == posOf.end() || B == posOf.end()) continue;
+            sf::Vector2f d = B->second - A->second;
+            float len = std::max(length(d), 1e-4f);
+            sf::Vector2f n(-d.y / len, d.x / len);
+            int order = std::clamp(L.order, 1, 3);
+            for (int s = 0; s < order; ++s) {
+                sf::Vector2f o = n * bondStrokeOffset(order, s, 4.f);
+                r.line(A->second + o, B->second + o, 2.f, sf::Color(120,200,255));
+            }
+        }
+    }
+    for (const auto& a : atoms) {
+        const Element& el = ELEMENTS[a.elementIndex];
+        r.disk(a.pos, a.nucleusRadius, sf::Color(el.color.r, el.color.g, el.color.b, a.selected ? 255 : 220));
+        r.ring(a.pos, a.nucleusRadius, a.nucleusRadius + (a.active ? 3.f : 1.f), nucleusOutlineColor(a));
+        if (v.showRings) {
+            for (const auto& e : a.electrons) r.ring(a.pos, e.radius, e.radius + 1.f, sf::Color(60,60,70));
+            for (const auto& e : a.electrons) {
+                sf::Vector2f p(a.pos.x + std::cos(e.angle) * e.radius, a.pos.y + std::sin(e.angle) * e.radius);
+                r.disk(p, 4.f, a.active ? sf::Color(180,255,255) : sf::Color(160,180,200));
+            }
+        }
+        r.text(el.symbol, {a.pos.x - 8, a.pos.y - 10}, 14, sf::Color::Black);
+    }
+    r.finish();
+}
+
+// Renders a generated scene with the software backend, no window or GL
+// context needed. With an output, frames go through the exporter (numbered
+// PNGs, or a .y4m / "-" stream); offline, it always waits rather than drops.
+int runHeadless(int frames, const std::string& output, FrameExporter::Config exportConfig, const std::string& profileJson) {
+    const int W = 1200, H = 800;
+    FastRng rng(11u);
+    AtomStore atoms;
+    std::vector<Link> links;
+    for (int i = 0; i < 40; ++i) {
+        int el = (int)(rng.next() % ELEMENTS.size());
+        sf::Vector2f pos(SIDEBAR_W + 60.f + rng.uniform() * (W - SIDEBAR_W - 120.f), 60.f + rng.uniform() * (H - 120.f));
+        atoms.add(i + 1, el, pos, makeElectronsForElement(ELEMENTS[el].atomicNumber), rng.uniform() < 0.5f);
+    }
+    for (size_t i = 0; i < atoms.size(); ++i) {
+        size_t best = i;
+        float bestD = 1e30f;
+        for (size_t j = 0; j < atoms.size(); ++j) {
+            float d = length(atoms[j].pos - atoms[i].pos);
+            if (j != i && d < bestD) { bestD = d; best = j; }
+        }
+        if (best > i) links.push_back({atoms[i].id, atoms[best].id});
+    }
+    SceneView view;
+    view.atoms = &atoms;
+    view.links = &links;
+    view.title = "Headless render (" + std::to_string(atoms.size()) + " atoms)";
+    SoftwareRenderer renderer;
+    FrameExporter exporter;
+    if (!output.empty()) {
+        exportConfig.target = output;
+        exportConfig.blockWhenFull = true;
+        if (!exporter.start(exportConfig)) { std::cerr << "Recording: " << exporter.error() << "\n"; return 1; }
+    }
+    PhaseProfiler profiler;
+    sf::Clock clock;
+    for (int f = 0; f < frames; ++f) {
+        profiler.beginFrame();
+        for (auto a : atoms)
+            if (a.active) for (auto& e : a.electrons) e.angle += e.speed * (1.f / 60.f);
+        profiler.mark("time update");
+        rasterizeScene(renderer, view, W, H);
+        profiler.mark("rasterize");
+        if (exporter.running()) exporter.submit((const uint8_t*)renderer.pixels.data(), W, H);
+        profiler.mark("export");
+    }
+    exporter.stop();
+    float sec = clock.getElapsedTime().asSeconds();
+    profiler.publish();
+    if (!profileJson.empty() && !profiler.writeJson(profileJson)) std::cerr << "Could not write " << profileJson << "\n";
+    // Progress goes to stderr so a Y4M stream on stdout stays clean
+    std::cerr << "headless: " << frames << " frames " << W << "x" << H << " in " << sec << " s = "
+              << frames / std::max(sec, 1e-6f) << " fps (" << frames / 60.f / std::max(sec, 1e-6f) << "x real time)";
+    if (!output.empty()) std::cerr << ", " << exporter.written() << " written to " << output;
+    std::cerr << "\n";
+    return 0;
+}
+
+// Headless benchmark: random scene, then events as fast as possible.
+int runKineticsBenchmark(int atomCount, long events) {
+    FastRng rng(7u);
+    AtomStore atoms;
+    // ~6 neighbours inside the cutoff on average
+    float side = std::sqrt(atomCount * 3.14159265f * BondKinetics::CUTOFF * BondKinetics::CUTOFF / 6.f);
+    for (int i = 0; i < atomCount; ++i) {
+        int el = (int)(rng.next() % ELEMENTS.size());
+        atoms.add(i + 1, el, {rng.uniform() * side, rng.uniform() * side});
+    }
+    std::vector<Link> links;
+    BondKinetics kin;
+    sf::Clock clock;
+    kin.build(atoms, links, 0.0);
+    float buildSec = clock.restart().asSeconds();
+    size_t fired = kin.advance(1e300, &links, (size_t)events);
+    float runSec = clock.getElapsedTime().asSeconds();
+    std::cout << "kinetics: " << atomCount << " atoms, " << kin.channelCount() << " channels (built in "
+              << buildSec << " s)\n"
+              << "  " << fired << " events in " << runSec << " s = " << (fired / std::max(runSec, 1e-6f)) / 1e6
+              << " M events/s, sim time " << kin.time() << " s, " << links.size() << " links\n";
+    return 0;
+}
+
+// Headless benchmark: drive a million-atom ensemble frame by frame.
+int runBlochBenchmark(int atomCount, int frames) {
+    AtomStore atoms;
+    for (int i = 0; i < atomCount; ++i) atoms.add(i + 1, 0, {0.f, 0.f}, {}, (i % 2) == 0);
+    BlochEngine bloch;
+    bloch.build(atoms);
+    for (int i = 1; i < atomCount; i += 2) bloch.pulse(i, 3.14159265f);
+    sf::Clock clock;
+    for (int f = 0; f < frames; ++f) bloch.step(1.f / 60.f);
+    float sec = clock.getElapsedTime().asSeconds();
+    std::cout << "bloch: " << atomCount << " atoms, " << frames << " frames in " << sec << " s = "
+              << 1000.f * sec / frames << " ms/frame (" << 1e9 * sec / ((double)frames * atomCount)
+              << " ns/atom/frame); P_e driven " << bloch.excited(0) << ", pi-pulsed " << bloch.excited(1) << "\n";
+    return 0;
+}
+
+// ---- Scene statistics ----
+
+// Sidebar counts kept current by the edits themselves, the same way the spectrum
+// gets atomActivated calls, so reading them costs nothing per frame. Molecules
+// are connected components over a per-atom link adjacency. Adding a link merges
+// by relabelling the smaller component. Removing one searches from both ends
+// at once and relabels only the side that comes out separated, so a bond
+// breaking costs the smaller piece, not the whole scene.
+class SceneStats {
+public:
+    // Drops atoms and links; activations already scheduled stay pending
+    void clear() {
+        perElement.assign(ELEMENTS.size(), 0);
+        atomTotal = activeTotal = linkTotal = 0;
+        slotOf.clear();
+        idOf.clear(); label.clear(); adj.clear(); dead.clear(); seen.clear();
+        freeSlots.clear();
+        size.clear(); freeLabels.clear();
+        sizeCount.clear();
+        moleculeCount = 0;
+        largestSize = 0;
+        ++rev;
+    }
+
+    void atomAdded(AtomView a) {
+        if (perElement.empty()) perElement.assign(ELEMENTS.size(), 0);
+        ++perElement[a.elementIndex];
+        ++atomTotal;
+        if (a.active) ++activeTotal;
+        int s;
+        if (!freeSlots.empty()) { s = freeSlots.back(); freeSlots.pop_back(); }
+        else {
+            s = (int)idOf.size();
+            idOf.push_back(0); label.push_back(0); adj.emplace_back(); dead.push_back(0); seen.push_back(0);
+        }
+        idOf[s] = a.id;
+        adj[s].clear();
+        dead[s] = 0;
+        label[s] = newLabel();
+        resize(label[s], 1);
+        slotOf[a.id] = s;
+        ++rev;
+    }
+
+    // The atom's links are reported separately with linkRemoved; its slot is
+    // retired once the last of them is gone
+    void atomRemoved(AtomView a) {
+        --perElement[a.elementIndex];
+        --atomTotal;
+        if (a.active) --activeTotal;
+        auto it = slotOf.find(a.id);
+        if (it != slotOf.end()) {
+            dead[it->second] = 1;
+            retireIfDone(it->second);
+        }
+        ++rev;
+    }
+
+    void atomActivated(int delta) {
+        activeTotal += delta;
+        ++rev;
+    }
+
+    void scheduled(int delta) {
+        scheduledTotal += delta;
+        ++rev;
+    }
+
+    void linkAdded(int aId, int bId) {
+        ++linkTotal;
+        auto a = slotOf.find(aId), b = slotOf.find(bId);
+        if (a != slotOf.end() && b != slotOf.end() && a->second != b->second) {
+            int sa = a->second, sb = b->second;
+            int la = label[sa], lb = label[sb];
+            if (la != lb) {
+                if (size[la] < size[lb]) { std::swap(sa, sb); std::swap(la, lb); }
+                int moved = size[lb];
+                relabel(sb, la); // before the edge exists, so this walks only sb's side
+                resize(lb, 0);
+                resize(la, size[la] + moved);
+            }
+            adj[sa].push_back(sb);
+            adj[sb].push_back(sa);
+        }
+        ++rev;
+    }
+
+    void linkRemoved(int aId, int bId) {
+        --linkTotal;
+        auto a = slotOf.find(aId), b = slotOf.find(bId);
+        if (a != slotOf.end() && b != slotOf.end() && a->second != b->second) {
+            int sa = a->second, sb = b->second;
+            dropEdge(sa, sb);
+            dropEdge(sb, sa);
+            split(sa, sb);
+            retireIfDone(sa);
+            retireIfDone(sb);
+        }
+        ++rev;
+    }
+
+    int elementCount(int elementIndex) const { return perElement.empty() ? 0 : perElement[elementIndex]; }
+    long atomCount() const { return atomTotal; }
+    long activeCount() const { return activeTotal; }
+    long scheduledCount() const { return scheduledTotal; }
+    long linkCount() const { return linkTotal; }
+    int molecules() const { return moleculeCount; }    // components of two or more atoms
+    int largestComponent() const { return largestSize; }
+    uint64_t revision() const { return rev; }          // changes whenever any count does
+
+private:
+    int newLabel() {
+        if (!freeLabels.empty()) { int l = freeLabels.back(); freeLabels.pop_back(); return l; }
+        size.push_back(0);
+        return (int)size.size() - 1;
+    }
+
+    // Moves a component between size classes, keeping the molecule count and
+    // the largest size current; size 0 frees the label
+    void resize(int l, int n) {
+        int old = size[l];
+        if (old > 0) --sizeCount[old];
+        if (old >= 2) --moleculeCount;
+        size[l] = n;
+        if (n > 0) {
+            if ((int)sizeCount.size() <= n) sizeCount.resize(n + 1, 0);
+            ++sizeCount[n];
+        } else {
+            freeLabels.push_back(l);
+        }
+        if (n >= 2) ++moleculeCount;
+        largestSize = std::max(largestSize, n);
+        while (largestSize > 0 && sizeCount[largestSize] == 0) --largestSize;
+    }
+
+    void dropEdge(int from, int to) {
+        auto& list = adj[from];
+        auto it = std::find(list.begin(), list.end(), to);
+        if (it == list.end()) return;
+        *it = list.back();
+        list.pop_back();
+    }
+
+    // Gives every slot connected to `start` the label l
+    void relabel(int start, int l) {
+        queue.clear();
+        queue.push_back(start);
+        label[start] = l;
+        for (size_t k = 0; k < queue.size(); ++k)
+            for (int t : adj[queue[k]])
+                if (label[t] != l) { label[t] = l; queue.push_back(t); }
+    }
+
+    // After the a-b edge is gone: grow both sides one node at a time. If they
+    // meet the component is intact; if one side runs out first it is the
+    // smaller piece and gets a fresh label.
+    void split(int a, int b) {
+        epoch += 2;
+        uint32_t markA = epoch, markB = epoch + 1;
+        queue.clear(); other.clear();
+        queue.push_back(a); seen[a] = markA;
+        other.push_back(b); seen[b] = markB;
+        size_t ka = 0, kb = 0;
+        auto grow = [&](std::vector<int>& q, size_t& k, uint32_t mine, uint32_t theirs) -> int {
+            // 1: met the other side, 0: still going, -1: exhausted
+            if (k == q.size()) return -1;
+            for (int t : adj[q[k++]]) {
+                if (seen[t] == theirs) return 1;
+                if (seen[t] != mine) { seen[t] = mine; q.push_back(t); }
+            }
+            return 0;
+        };
+        for (;;) {
+            int ra = grow(queue, ka, markA, markB);
+            if (ra == 1) return;
+            if (ra == -1) { detach(queue, label[a]); return; }
+            int rb = grow(other, kb, markB, markA);
+            if (rb == 1) return;
+            if (rb == -1) { detach(other, label[b]); return; }
+        }
+    }
+
+    void detach(const std::vector<int>& piece, int from) {
+        int l = newLabel();
+        for (int s : piece) label[s] = l;
+        resize(from, size[from] - (int)piece.size());
+        resize(l, (int)piece.size());
+    }
+
+    // A removed atom keeps its slot until its links are gone too
+    void retireIfDone(int s) {
+        if (!dead[s] || !adj[s].empty()) return;
+        resize(label[s], size[label[s]] - 1);
+        slotOf.erase(idOf[s]);
+        dead[s] = 0;
+        freeSlots.push_back(s);
+    }
+
+    std::vector<int> perElement;
+    long atomTotal = 0, activeTotal = 0, scheduledTotal = 0, linkTotal = 0;
+    std::unordered_map<int, int> slotOf;  // atom id -> slot
+    std::vector<int> idOf, label;         // per slot
+    std::vector<std::vector<int>> adj;    // per slot: linked slots
+    std::vector<uint8_t> dead;            // removed, waiting for its links to go
+    std::vector<uint32_t> seen;           // split() marks
+    std::vector<int> freeSlots;
+    std::vector<int> size, freeLabels;    // per component label
+    std::vector<int> sizeCount;           // components of each size
+    std::vector<int> queue, other;        // search scratch, reused
+    uint32_t epoch = 0;
+    int moleculeCount = 0, largestSize = 0;
+    uint64_t rev = 0;
 };
 
-struct Button {
-    sf::RectangleShape box;
-    sf::Text label;
-    std::function<void()> onClick;
-    bool hover = false;
+// ---- Atom queries ----
+
+// One term of a query; a query matches the atoms that pass all of its terms.
+//   element=O  element!=C      active  idle  scheduled  !scheduled
+//   degree>2   links<=1        molecule=3                (= == != < <= > >=)
+//   in rect(x, y, w, h)        "and" between terms is optional
+struct AtomPredicate {
+    enum Field { Element, Active, Scheduled, Degree, Molecule, Region };
+    enum Cmp { Eq, Ne, Lt, Le, Gt, Ge };
+    Field field = Element;
+    Cmp cmp = Eq;
+    int value = 0;
+    sf::FloatRect rect;
 };
 
-static const float SIDEBAR_W = 320.f;
+int elementBySymbol(const std::string& symbol);
 
-sf::Text makeText(const std::string& s, const sf::Font& font, unsigned size, sf::Color color, sf::Vector2f pos) {
-    sf::Text t;
-    t.setFont(font);
-    t.setString(s);
-    t.setCharacterSize(size);
-    t.setFillColor(color);
-    t.setPosition(pos);
-    return t;
+bool parseAtomQuery(const std::string& query, std::vector<AtomPredicate>& out, std::string& error) {
+    std::string text = query;
+    for (char& c : text) if (c == '(' || c == ')' || c == ',') c = ' ';
+    std::vector<std::string> words;
+    for (size_t i = 0; i < text.size();) {
+        while (i < text.size() && std::isspace((unsigned char)text[i])) ++i;
+        size_t j = i;
+        while (j < text.size() && !std::isspace((unsigned char)text[j])) ++j;
+        if (j > i) words.push_back(text.substr(i, j - i));
+        i = j;
+    }
+    out.clear();
+    for (size_t k = 0; k < words.size(); ++k) {
+        std::string w = words[k];
+        for (char& c : w) c = (char)std::tolower((unsigned char)c);
+        AtomPredicate p;
+        if (w == "and" || w == "all") continue;
+        if (w == "in" && k + 1 < words.size() && words[k + 1] == "rect") continue;
+        if (w == "rect") {
+            double r[4];
+            for (int q = 0; q < 4; ++q) {
+                char* end = nullptr;
+                r[q] = k + 1 + q < words.size() ? std::strtod(words[k + 1 + q].c_str(), &end) : 0.0;
+                if (k + 1 + q >= words.size() || *end) { error = "rect needs x, y, w, h"; return false; }
+            }
+            p.field = AtomPredicate::Region;
+            p.rect = sf::FloatRect((float)r[0], (float)r[1], (float)r[2], (float)r[3]);
+            out.push_back(p);
+            k += 4;
+            continue;
+        }
+        bool negate = !w.empty() && w[0] == '!';
+        std::string flag = negate ? w.substr(1) : w;
+        if (flag == "active" || flag == "idle" || flag == "scheduled") {
+            p.field = flag == "scheduled" ? AtomPredicate::Scheduled : AtomPredicate::Active;
+            p.value = (flag == "idle") == negate ? 1 : 0;
+            out.push_back(p);
+            continue;
+        }
+        size_t op = w.find_first_of("=!<>");
+        if (op == std::string::npos || op == 0) { error = "unknown term '" + words[k] + "'"; return false; }
+        std::string field = w.substr(0, op), cmp, value;
+        size_t v = op;
+        while (v < w.size() && std::strchr("=!<>", w[v])) ++v;
+        cmp = w.substr(op, v - op);
+        value = words[k].substr(v);
+        static const std::pair<const char*, AtomPredicate::Cmp> cmps[] = {
+            {"=", AtomPredicate::Eq}, {"==", AtomPredicate::Eq}, {"!=", AtomPredicate::Ne}, {"<", AtomPredicate::Lt},
+            {"<=", AtomPredicate::Le}, {">", AtomPredicate::Gt}, {">=", AtomPredicate::Ge}
+        };
+        auto it = std::find_if(std::begin(cmps), std::end(cmps), [&](const auto& c){ return cmp == c.first; });
+        if (it == std::end(cmps) || value.empty()) { error = "bad comparison in '" + words[k] + "'"; return false; }
+        p.cmp = it->second;
+        if (field == "element") {
+            p.field = AtomPredicate::Element;
+            p.value = elementBySymbol(value);
+            if (p.value < 0) { error = "unknown element '" + value + "'"; return false; }
+            if (p.cmp != AtomPredicate::Eq && p.cmp != AtomPredicate::Ne) { error = "element only takes = or !="; return false; }
+        } else if (field == "degree" || field == "links" || field == "molecule") {
+            p.field = field == "molecule" ? AtomPredicate::Molecule : AtomPredicate::Degree;
+            char* end = nullptr;
+            p.value = (int)std::strtol(value.c_str(), &end, 10);
+            if (*end) { error = "expected a number in '" + words[k] + "'"; return false; }
+        } else {
+            error = "unknown field '" + field + "'";
+            return false;
+        }
+        out.push_back(p);
+    }
+    return true;
 }
 
-Button makeButton(const std::string& label, const sf::Font& font, const sf::Vector2f& pos, const sf::Vector2f& size, std::function<void()> onClick) {
-    Button b;
-    b.box.setPosition(pos);
-    b.box.setSize(size);
-    b.box.setFillColor(sf::Color(40,40,50));
-    b.box.setOutlineThickness(1.f);
-    b.box.setOutlineColor(sf::Color(90,90,110));
-    b.label = makeText(label, font, 16, sf::Color::White, {pos.x + 12, pos.y + 8});
-    b.onClick = std::move(onClick);
-    return b;
+// The scene as columns for queries. Topology columns (element, degree, molecule)
+// and the per-element row index are rebuilt when sceneVersion or the link list
+// changes; the live columns (active, scheduled, position) are refreshed on every
+// sync. select() produces a bitset, bit i for atoms[i].
+class AtomTable {
+public:
+    std::vector<uint8_t> element, active, scheduled;
+    std::vector<int> degree, molecule;
+    std::vector<float> x, y;
+
+    size_t size() const { return element.size(); }
+
+    void sync(const AtomStore& atoms, const std::vector<Link>& links, int sceneVersion) {
+        size_t n = atoms.size();
+        if (version != sceneVersion || n != element.size() || !sameLinks(links)) rebuild(atoms, links, sceneVersion);
+        for (size_t i = 0; i < n; ++i) {
+            active[i] = atoms[i].active;
+            x[i] = atoms[i].pos.x;
+            y[i] = atoms[i].pos.y;
+        }
+        const AtomWorld& world = atoms.world();
+        for (size_t i = 0; i < n; ++i) scheduled[i] = world.has<Scheduled>(world.entity(i));
+        gridFresh = false;
+    }
+
+    // Seeds the candidates from the most selective index (element, then region),
+    // then narrows them one predicate at a time. Each predicate is a branch-free
+    // pass over its column 64 rows per word, skipping words already empty.
+    void select(const std::vector<AtomPredicate>& preds, std::vector<uint64_t>& bits) {
+        size_t n = size(), words = (n + 63) / 64;
+        const AtomPredicate* seed = nullptr;
+        for (const auto& p : preds) if (p.field == AtomPredicate::Element && p.cmp == AtomPredicate::Eq) { seed = &p; break; }
+        if (!seed) for (const auto& p : preds) if (p.field == AtomPredicate::Region) { seed = &p; break; }
+
+        if (!seed) {
+            bits.assign(words, ~0ull);
+            if (n % 64) bits.back() = (1ull << (n % 64)) - 1;
+        } else if (seed->field == AtomPredicate::Element) {
+            bits.assign(words, 0);
+            for (int k = elementStart[seed->value]; k < elementStart[seed->value + 1]; ++k) setBit(bits, elementRows[k]);
+        } else {
+            bits.assign(words, 0);
+            if (!gridFresh) {
+                grid.build(n, [&](size_t i){ return sf::Vector2f(x[i], y[i]); }, 64.f, 0.f);
+                gridFresh = true;
+            }
+            const sf::FloatRect& r = seed->rect;
+            sf::Vector2f center(r.left + 0.5f * r.width, r.top + 0.5f * r.height);
+            grid.forEachNear(center, 0.5f * std::max(r.width, r.height), [&](int i){ setBit(bits, i); });
+        }
+
+        for (const auto& p : preds) {
+            if (&p == seed && p.field == AtomPredicate::Element) continue; // the index is exact
+            switch (p.field) {
+            case AtomPredicate::Element:   compare(element, p.cmp, p.value, bits); break;
+            case AtomPredicate::Active:    compare(active, p.cmp, p.value, bits); break;
+            case AtomPredicate::Scheduled: compare(scheduled, p.cmp, p.value, bits); break;
+            case AtomPredicate::Degree:    compare(degree, p.cmp, p.value, bits); break;
+            case AtomPredicate::Molecule:  compare(molecule, p.cmp, p.value, bits); break;
+            case AtomPredicate::Region: {
+                float x0 = p.rect.left, x1 = x0 + p.rect.width, y0 = p.rect.top, y1 = y0 + p.rect.height;
+                narrow(bits, [&](size_t i){ return (x[i] >= x0) & (x[i] < x1) & (y[i] >= y0) & (y[i] < y1); });
+                break;
+            }
+            }
+        }
+    }
+
+private:
+    static void setBit(std::vector<uint64_t>& bits, size_t i) { bits[i >> 6] |= 1ull << (i & 63); }
+
+    template <class Test>
+    void narrow(std::vector<uint64_t>& bits, Test test) const {
+        size_t n = size();
+        for (size_t w = 0; w < bits.size(); ++w) {
+            if (!bits[w]) continue;
+            size_t base = w * 64, end = std::min(n, base + 64);
+            uint64_t keep = 0;
+            for (size_t i = base; i < end; ++i) keep |= (uint64_t)test(i) << (i - base);
+            bits[w] &= keep;
+        }
+    }
+
+    template <class T>
+    void compare(const std::vector<T>& col, AtomPredicate::Cmp cmp, int v, std::vector<uint64_t>& bits) const {
+        const T* c = col.data();
+        switch (cmp) {
+        case AtomPredicate::Eq: narrow(bits, [&](size_t i){ return (int)c[i] == v; }); break;
+        case AtomPredicate::Ne: narrow(bits, [&](size_t i){ return (int)c[i] != v; }); break;
+        case AtomPredicate::Lt: narrow(bits, [&](size_t i){ return (int)c[i] < v; }); break;
+        case AtomPredicate::Le: narrow(bits, [&](size_t i){ return (int)c[i] <= v; }); break;
+        case AtomPredicate::Gt: narrow(bits, [&](size_t i){ return (int)c[i] > v; }); break;
+        case AtomPredicate::Ge: narrow(bits, [&](size_t i){ return (int)c[i] >= v; }); break;
+        }
+    }
+
+    bool sameLinks(const std::vector<Link>& links) const {
+        if (links.size() != cachedLinks.size()) return false;
+        for (size_t k = 0; k < links.size(); ++k)
+            if (links[k].aId != cachedLinks[k].aId || links[k].bId != cachedLinks[k].bId) return false;
+        return true;
+    }
+
+    void rebuild(const AtomStore& atoms, const std::vector<Link>& links, int sceneVersion) {
+        size_t n = atoms.size();
+        version = sceneVersion;
+        cachedLinks = links;
+        element.resize(n);
+        active.resize(n);
+        scheduled.resize(n);
+        x.resize(n);
+        y.resize(n);
+        degree.assign(n, 0);
+        molecule.resize(n);
+        std::unordered_map<int, int> rowOf;
+        rowOf.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            element[i] = (uint8_t)atoms[i].elementIndex;
+            rowOf[atoms[i].id] = (int)i;
+        }
+        // Molecules are the connected components of the link graph
+        std::vector<int> parent(n);
+        for (size_t i = 0; i < n; ++i) parent[i] = (int)i;
+        auto find = [&](int i){
+            while (parent[i] != i) i = parent[i] = parent[parent[i]];
+            return i;
+        };
+        for (const auto& L : links) {
+            auto a = rowOf.find(L.aId), b = rowOf.find(L.bId);
+            if (a == rowOf.end() || b == rowOf.end()) continue;
+            ++degree[a->second];
+            ++degree[b->second];
+            int ra = find(a->second), rb = find(b->second);
+            if (ra != rb) parent[std::max(ra, rb)] = std::min(ra, rb);
+        }
+        std::vector<int> label(n, -1);
+        int molecules = 0;
+        for (size_t i = 0; i < n; ++i) {
+            int r = find((int)i);
+            if (label[r] < 0) label[r] = molecules++;
+            molecule[i] = label[r];
+        }
+        elementStart.assign(ELEMENTS.size() + 1, 0);
+        for (size_t i = 0; i < n; ++i) ++elementStart[element[i] + 1];
+        for (size_t e = 0; e < ELEMENTS.size(); ++e) elementStart[e + 1] += elementStart[e];
+        elementRows.resize(n);
+        std::vector<int> fill(elementStart.begin(), elementStart.end() - 1);
+        for (size_t i = 0; i < n; ++i) elementRows[fill[element[i]]++] = (int)i;
+    }
+
+    int version = -1;
+    std::vector<Link> cachedLinks;
+    std::vector<int> elementStart, elementRows; // rows grouped by element
+    SpatialGrid grid;
+    bool gridFresh = false;
+};
+
+// ---- Scene scripts ----
+
+// One line of the console / --script language. Each command maps onto one bulk
+// operation over the scene rather than a replay of button clicks:
+//   add <symbol> <count> [in rect(x, y, w, h)]    random positions, default the canvas;
+//                           at most SceneCommand::MAX_ADD atoms per line
+//   select none | <query>   replaces the selection; queries as in parseAtomQuery
+//   link nearest [factor]   selected atoms (all if none) to their nearest atom within
+//                           factor x the covalent bond length, default 1.2
+//   toggle | remove | clear
+//   schedule +<seconds>     activate the selection after a delay
+//   run <time>              let the simulation run: 10s, 500ms or plain seconds
+// Blank lines and everything after '#' are ignored.
+struct SceneCommand {
+    enum Op { None, Add, Select, LinkNearest, Toggle, Schedule, Run, Remove, Clear };
+    static constexpr int MAX_ADD = 1000000; // atoms per add line; larger counts are rejected
+    Op op = None;
+    int element = -1;
+    int count = 0;
+    bool inRect = false;
+    sf::FloatRect rect;
+    std::string filter; // select
+    double value = 0.0; // link factor, schedule delay or run time in seconds
+};
+
+int elementBySymbol(const std::string& symbol) {
+    for (size_t i = 0; i < ELEMENTS.size(); ++i) {
+        const std::string& s = ELEMENTS[i].symbol;
+        if (s.size() == symbol.size() && std::equal(s.begin(), s.end(), symbol.begin(),
+                [](char a, char b){ return std::tolower((unsigned char)a) == std::tolower((unsigned char)b); }))
+            return (int)i;
+    }
+    return -1;
 }
 
-bool pointInRect(const sf::Vector2f& p, const sf::FloatRect& r) {
-    return r.contains(p);
+// Seconds from "10s", "500ms" or "2"; negative if malformed
+double parseDuration(std::string text) {
+    if (!text.empty() && text[0] == '+') text.erase(0, 1);
+    double scale = 1.0;
+    if (text.size() > 2 && text.compare(text.size() - 2, 2, "ms") == 0) { scale = 1e-3; text.resize(text.size() - 2); }
+    else if (text.size() > 1 && text.back() == 's') text.pop_back();
+    char* end = nullptr;
+    double v = std::strtod(text.c_str(), &end);
+    return (text.empty() || *end) ? -1.0 : v * scale;
 }
 
-float length(const sf::Vector2f& v) {
-    return std::sqrt(v.x*v.x + v.y*v.y);
+// Parses one line into `out`; returns false with a message in `error`. A blank or
+// comment line parses to Op::None.
+bool parseSceneCommand(const std::string& line, SceneCommand& out, std::string& error) {
+    std::string text = line.substr(0, line.find('#'));
+    for (char& c : text) if (c == '(' || c == ')' || c == ',') c = ' ';
+    std::vector<std::string> words;
+    {
+        size_t i = 0;
+        while (i < text.size()) {
+            while (i < text.size() && std::isspace((unsigned char)text[i])) ++i;
+            size_t j = i;
+            while (j < text.size() && !std::isspace((unsigned char)text[j])) ++j;
+            if (j > i) words.push_back(text.substr(i, j - i));
+            i = j;
+        }
+    }
+    out = SceneCommand();
+    if (words.empty()) return true;
+    std::string verb = words[0];
+    for (char& c : verb) c = (char)std::tolower((unsigned char)c);
+    auto number = [&](size_t k, double& v) {
+        if (k >= words.size()) return false;
+        char* end = nullptr;
+        v = std::strtod(words[k].c_str(), &end);
+        return *end == 0;
+    };
+
+    if (verb == "add") {
+        double count = 0;
+        if (words.size() < 3 || (out.element = elementBySymbol(words[1])) < 0 || !number(2, count) || count < 1) {
+            error = "usage: add <symbol> <count> [in rect(x, y, w, h)]";
+            return false;
+        }
+        if (!(count <= SceneCommand::MAX_ADD)) { // also catches nan
+            error = "add: at most " + std::to_string(SceneCommand::MAX_ADD) + " atoms per line";
+            return false;
+        }
+        out.op = SceneCommand::Add;
+        out.count = (int)count;
+        if (words.size() > 3) {
+            double r[4];
+            if (words.size() != 9 || words[3] != "in" || words[4] != "rect" ||
+                !number(5, r[0]) || !number(6, r[1]) || !number(7, r[2]) || !number(8, r[3])) {
+                error = "usage: add <symbol> <count> in rect(x, y, w, h)";
+                return false;
+            }
+            out.inRect = true;
+            out.rect = sf::FloatRect((float)r[0], (float)r[1], (float)r[2], (float)r[3]);
+        }
+    } else if (verb == "select") {
+        if (words.size() < 2) { error = "usage: select none | <query>, e.g. select element=O active degree>2"; return false; }
+        out.op = SceneCommand::Select;
+        for (size_t k = 1; k < words.size(); ++k) out.filter += (k > 1 ? " " : "") + words[k];
+    } else if (verb == "link") {
+        out.op = SceneCommand::LinkNearest;
+        out.value = 1.2;
+        if (words.size() < 2 || words[1] != "nearest" || (words.size() > 2 && (!number(2, out.value) || out.value <= 0))) {
+            error = "usage: link nearest [factor]";
+            return false;
+        }
+    } else if (verb == "toggle") {
+        out.op = SceneCommand::Toggle;
+    } else if (verb == "remove") {
+        out.op = SceneCommand::Remove;
+    } else if (verb == "clear") {
+        out.op = SceneCommand::Clear;
+    } else if (verb == "schedule" || verb == "run") {
+        out.op = verb == "run" ? SceneCommand::Run : SceneCommand::Schedule;
+        out.value = words.size() == 2 ? parseDuration(words[1]) : -1.0;
+        if (out.value < 0) { error = "usage: " + verb + (verb == "run" ? " <time>" : " +<seconds>"); return false; }
+    } else {
+        error = "unknown command '" + words[0] + "'";
+        return false;
+    }
+    return true;
 }
 
-sf::Vector2f clampToCanvas(const sf::Vector2f& p, const sf::Vector2u& winSize) {
-    float x = std::clamp(p.x, SIDEBAR_W + 20.f, (float)winSize.x - 20.f);
-    float y = std::clamp(p.y, 20.f, (float)winSize.y - 20.f);
-    return {x, y};
+// Parses a whole script; the first bad line fails it with "line N: ..." in `error`
+bool parseSceneScript(std::istream& in, std::vector<SceneCommand>& out, std::string& error) {
+    std::string line;
+    for (int n = 1; std::getline(in, line); ++n) {
+        SceneCommand c;
+        if (!parseSceneCommand(line, c, error)) { error = "line " + std::to_string(n) + ": " + error; return false; }
+        if (c.op != SceneCommand::None) out.push_back(c);
+    }
+    return true;
 }
 
-std::vector<Electron> makeElectronsForElement(int atomicNumber) {
-    // Simple, visual-only distribution over shells (not physically accurate)
-    // Shell radii and max electrons per shell (2, 8, 18, 32...) — we’ll cap visually
-    std::vector<int> shellCap = {2, 8, 8, 18}; // simplified caps
-    std::vector<float> radii   = {30.f, 50.f, 70.f, 90.f};
+// Wall time of each startup phase, printed with --startup-report
+struct StartupTimer {
+    sf::Clock clock;
+    float last = 0.f;
+    std::vector<std::pair<std::string, float>> phases; // name, ms
 
-    std::vector<Electron> e;
-    int remaining = std::min(atomicNumber, 24); // cap for rendering
-    std::srand((unsigned)std::time(nullptr));
+    void mark(const std::string& name) {
+        float now = clock.getElapsedTime().asSeconds() * 1000.f;
+        phases.push_back({name, now - last});
+        last = now;
+    }
 
-    for (size_t s = 0; s < shellCap.size() && remaining > 0; ++s) {
-        int inShell = std::min(remaining, shellCap[s]);
-        for (int i = 0; i < inShell; ++i) {
-            float angle = (2.f * 3.1415926f * i) / std::max(1, inShell);
-            float speed = (s % 2 == 0 ? 0.8f : -0.5f) * (1.f - s*0.1f);
-            speed += ((std::rand() % 100) / 100.f - 0.5f) * 0.2f; // slight variance
-            e.push_back({radii[s], angle, speed});
+    void report(std::ostream& out) const {
+        out << "Startup phases:\n";
+        for (const auto& p : phases) {
+            char line[96];
+            std::snprintf(line, sizeof(line), "  %-22s %8.2f ms\n", p.first.c_str(), p.second);
+            out << line;
+        }
+    }
+};
+
+int main(int argc, char** argv) {
+    StartupTimer startup;
+    bool startupReport = false;
+    bool allocReport = false;
+    std::string profileJson; // --headless per-phase report
+    std::string scriptPath;  // scene script run as a timeline at startup
+    std::string shmName;     // publish every step to this shared-memory feed
+    uint32_t shmAtoms = 65536;
+    // Recording options, shared by the Record button and --headless
+    FrameExporter::Config exportConfig;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--startup-report") startupReport = true;
+        if (arg == "--alloc-report") allocReport = true;
+        if (arg == "--profile-json" && hasValue) profileJson = argv[i + 1];
+        if (arg == "--script" && hasValue) scriptPath = argv[i + 1];
+        if (arg == "--shm" && hasValue) shmName = argv[i + 1];
+        if (arg == "--shm-atoms" && hasValue) shmAtoms = (uint32_t)std::max(1, std::atoi(argv[i + 1]));
+        if (arg == "--record-target" && hasValue) exportConfig.target = argv[i + 1];
+        if (arg == "--record-queue" && hasValue) exportConfig.queueFrames = (size_t)std::max(1, std::atoi(argv[i + 1]));
+        if (arg == "--record-threads" && hasValue) exportConfig.threads = (unsigned)std::max(0, std::atoi(argv[i + 1]));
+        if (arg == "--record-block") exportConfig.blockWhenFull = true;
+    }
+    auto positional = [&](int k) -> const char* {
+        return (k < argc && std::string(argv[k]).rfind("--", 0) != 0) ? argv[k] : nullptr;
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--kinetics-bench") {
+            int atomCount = (i + 1 < argc) ? std::atoi(argv[i + 1]) : 100000;
+            long events = (i + 2 < argc) ? std::atol(argv[i + 2]) : 10000000;
+            return runKineticsBenchmark(atomCount, events);
+        }
+        if (arg == "--headless") {
+            int frames = positional(i + 1) ? std::atoi(argv[i + 1]) : 600;
+            const char* output = positional(i + 1) ? positional(i + 2) : nullptr;
+            return runHeadless(frames, output ? output : "", exportConfig, profileJson);
+        }
+        if (arg == "--bloch-bench") {
+            int atomCount = (i + 1 < argc) ? std::atoi(argv[i + 1]) : 1000000;
+            int frames = (i + 2 < argc) ? std::atoi(argv[i + 2]) : 600;
+            return runBlochBenchmark(atomCount, frames);
         }
-        remaining -= inShell;
     }
-    return e;
-}
 
-int main() {
+    startup.mark("argument parsing");
     sf::RenderWindow window(sf::VideoMode(1200, 800), "Quantum Atom Sandbox");
     window.setFramerateLimit(60);
+    startup.mark("window creation");
 
     sf::Font font;
-    if (!font.loadFromFile("DejaVuSans.ttf")) {
+    std::thread glyphWarmup;
+    if (!loadUiFont(font)) {
         std::cerr << "Warning: DejaVuSans.ttf not found. Text will not render.\n";
+    } else {
+        glyphWarmup = std::thread(prewarmGlyphs, std::cref(font));
     }
+    startup.mark("font load");
+
+    // The radial levels of the whole element table are only needed once an atom is added,
+    // so they are solved in the background; radialLevels() blocks if a click beats it.
+    std::future<void> elementTable = std::async(std::launch::async, [startupReport](){
+        sf::Clock clock;
+        radialLevels(ELEMENTS.front().atomicNumber);
+        if (startupReport) {
+            std::cerr << "Startup: element table ready after " << clock.getElapsedTime().asMilliseconds()
+                      << " ms (background)\n";
+        }
+    });
+    startup.mark("element table init");
 
     // State
-    std::vector<Atom> atoms;
+    AtomStore atoms;
     std::vector<Link> links;
     int nextId = 1;
+    SceneStats stats; // every edit below keeps it current
+    ShmPublisher publisher; // so does every link edit, while --shm is on
     int selectedElement = 0;
+    int sceneVersion = 0; // bumped by every user edit to atoms, links, positions or active states
+    std::vector<int> listedRows; // atom indices in list order, as last drawn; dropped when atoms are removed
 
     sf::Clock simClock;
     bool dragging = false;
@@ -143,56 +5634,336 @@ int main() {
     // UI elements
     std::vector<Button> buttons;
 
+    // Display modes
+    bool showClouds = false;
+    OrbitalCloudCache cloudCache(256);
+    bool showWave = false;
+    WavepacketSolver wave;
+    bool showPhotons = false;
+    PhotonPool photons;
+    SpatialGrid grid;
+    FastRng photonRng;
+    std::vector<int> photonHits;
+    bool showSpectrum = false;
+    SpectrumEngine spectrum;
+    bool runKinetics = false;
+    BondKinetics kinetics;
+    int kineticsVersion = -1, kineticsPositions = -1;
+    float kineticsBuilt = 0.f;
+    const float KINETICS_REBUILD = 0.5f; // s between channel rebuilds while atoms drift
+    int linksRevision = 0; // bumped when kinetics forms or breaks bonds; user edits bump sceneVersion
+    int positionsRevision = 0; // bumped by thermal motion, which doesn't bump sceneVersion
+    kinetics.onBond = [&](int a, int b, bool formed){
+        formed ? stats.linkAdded(a, b) : stats.linkRemoved(a, b);
+        publisher.linkChanged(a, b, formed ? 1 : 0);
+    };
+    int spinMode = -1; // -1 off, otherwise a SpinModel::Algorithm
+    bool spinsOn = false;
+    SpinModel spins;
+    int spinsVersion = -1, spinsLinks = -1;
+    bool showBloch = false;
+    BlochEngine bloch;
+    int blochVersion = -1;
+    std::vector<size_t> blochPulses; // atoms whose scheduled pi pulse fired this frame
+    bool showStructure = false;
+    std::future<StructureResult> structureJob;
+    StructureResult structure;
+    const int STRUCTURE_EVERY = 30; // frames between analysis snapshots
+    long frameIndex = 0;
+    bool runThermal = false;
+    ThermalMotion thermal;
+    MsdCorrelator msd;
+    int thermalVersion = -1;
+    FrameArena frameArena(256 * 1024);
+    PhaseProfiler profiler; // counters follow this (the main) thread
+    const long PROFILE_WINDOW = 120; // frames per published average
+    bool showProfiler = false; // F3
+    std::vector<sf::Text> profilerCells;
+    LinkBatch linkBatch;
+    NucleusAtlas nucleusAtlas; // built on the first frame, once the window's context is current
+    SoftwareRenderer cpuRenderer; // F12: screenshot through the software backend
+    bool recording = false;
+    FrameExporter exporter;
+    sf::Texture captureTexture;
+    std::unordered_map<std::string, HFResult> hfCache; // canonical molecule -> result
+    std::future<HFResult> hfJob;
+    std::string hfJobKey;
+    std::string status; // sidebar status line: the latest message from HF, export, scripts, ...
+    TimelineScheduler timelines; // scripted sequences, resumed once per frame
+    startup.mark("scene load");
+    auto canvasRect = [&](){
+        return sf::FloatRect(SIDEBAR_W, 0.f, (float)window.getSize().x - SIDEBAR_W, (float)window.getSize().y);
+    };
+
     auto addAtom = [&](){
         const Element& el = ELEMENTS[selectedElement];
-        Atom a;
-        a.id = nextId++;
-        a.elementIndex = selectedElement;
-        a.pos = { SIDEBAR_W + 100.f + (float)(std::rand()%600), 100.f + (float)(std::rand()%500) };
-        a.electrons = makeElectronsForElement(el.atomicNumber);
-        a.active = false;
-        a.selected = false;
-        atoms.push_back(std::move(a));
+        sf::Vector2f pos(SIDEBAR_W + 100.f + (float)(std::rand()%600), 100.f + (float)(std::rand()%500));
+        stats.atomAdded(atoms.add(nextId++, selectedElement, pos, makeElectronsForElement(el.atomicNumber)));
+        ++sceneVersion;
     };
 
     auto removeSelected = [&](){
-        std::vector<int> toRemoveIds;
-        for (auto& a : atoms) if (a.selected) toRemoveIds.push_back(a.id);
-        atoms.erase(std::remove_if(atoms.begin(), atoms.end(), [&](const Atom& a){
-            return std::find(toRemoveIds.begin(), toRemoveIds.end(), a.id) != toRemoveIds.end();
-        }), atoms.end());
+        std::pmr::vector<int> toRemoveIds(frameArena.get());
+        for (auto a : atoms) if (a.selected) {
+            toRemoveIds.push_back(a.id);
+            if (a.active) spectrum.atomActivated(a.elementIndex, -1);
+            stats.atomRemoved(a);
+        }
+        // Sorted, so removing a scripted selection of thousands stays linear-ish
+        std::sort(toRemoveIds.begin(), toRemoveIds.end());
+        auto removed = [&](int id){ return std::binary_search(toRemoveIds.begin(), toRemoveIds.end(), id); };
+        atoms.removeIf([](AtomView a){ return a.selected; });
+        listedRows.clear(); // indices shift; the list is rebuilt when next drawn
         links.erase(std::remove_if(links.begin(), links.end(), [&](const Link& L){
-            return std::find(toRemoveIds.begin(), toRemoveIds.end(), L.aId) != toRemoveIds.end() ||
-                   std::find(toRemoveIds.begin(), toRemoveIds.end(), L.bId) != toRemoveIds.end();
+            if (!removed(L.aId) && !removed(L.bId)) return false;
+            stats.linkRemoved(L.aId, L.bId);
+            publisher.linkChanged(L.aId, L.bId, 0);
+            return true;
         }), links.end());
+        ++sceneVersion;
     };
 
     auto toggleActiveSelected = [&](){
-        for (auto& a : atoms) if (a.selected) a.active = !a.active;
+        for (auto a : atoms) if (a.selected) {
+            a.active = !a.active;
+            spectrum.atomActivated(a.elementIndex, a.active ? 1 : -1);
+            stats.atomActivated(a.active ? 1 : -1);
+            ++sceneVersion;
+        }
+    };
+
+    // Timelines refer to atoms by id and look them up through the store's id index when
+    // they resume; the atoms may be gone. While waiting, each atom carries a Scheduled component.
+    auto scheduledActivation = [&](std::vector<int> ids, double delay) -> Timeline {
+        AtomWorld& world = atoms.world();
+        for (int id : ids) {
+            Entity e = atoms.find(id);
+            if (e == AtomStore::NONE) continue;
+            if (world.has<Scheduled>(e)) ++world.get<Scheduled>(e).pending;
+            else world.add(e, Scheduled{1});
+        }
+        stats.scheduled((int)ids.size());
+        co_await timelines.after(delay);
+        stats.scheduled(-(int)ids.size());
+        for (int id : ids) {
+            Entity e = atoms.find(id);
+            if (e == AtomStore::NONE) continue;
+            if (world.has<Scheduled>(e) && --world.get<Scheduled>(e).pending == 0) world.remove<Scheduled>(e);
+            if (showBloch) {
+                // With the Bloch drive on, a schedule fires a pi pulse instead of latching the atom active
+                blochPulses.push_back(atoms.indexOf(e));
+                continue;
+            }
+            AtomRef a = atoms.ref(e);
+            if (!a.active) { spectrum.atomActivated(a.elementIndex, 1); stats.atomActivated(1); ++sceneVersion; }
+            a.active = true;
+        }
     };
 
-    auto scheduleSelected = [&](){
-        float t = simClock.getElapsedTime().asSeconds();
-        for (auto& a : atoms) if (a.selected) a.scheduledStart = t + 2.0f; // +2s
+    // Spawns one timeline for the current selection; returns how many atoms it covers
+    auto scheduleSelection = [&](double delay) -> long {
+        std::vector<int> ids;
+        for (const auto& a : atoms) if (a.selected) ids.push_back(a.id);
+        if (ids.empty()) return 0;
+        long n = (long)ids.size();
+        timelines.spawn(scheduledActivation(std::move(ids), delay));
+        return n;
     };
 
+    auto scheduleSelected = [&](){ scheduleSelection(2.0); };
+
     auto clearAll = [&](){
         atoms.clear();
+        listedRows.clear();
         links.clear();
+        spectrum.reset();
+        stats.clear();
+        publisher.linksReset();
+        ++sceneVersion;
+    };
+
+    auto computeHartreeFock = [&](){
+        if (hfJob.valid()) return; // one molecule at a time
+        int seed = -1;
+        for (auto a : atoms) if (a.selected) { seed = a.id; break; }
+        if (seed == -1) { status = "HF: select an atom of the molecule"; return; }
+        std::vector<Nucleus> nuclei = moleculeFromScene(atoms, links, seed);
+        std::string key = canonicalMoleculeKey(nuclei);
+        auto it = hfCache.find(key);
+        if (it != hfCache.end()) { status = describeHF(it->second) + " [cached]"; return; }
+        hfJobKey = key;
+        status = "HF: computing " + std::to_string(nuclei.size()) + " atoms...";
+        hfJob = std::async(std::launch::async, runRestrictedHartreeFock, nuclei);
     };
 
     auto linkPair = [&](){
-        std::vector<int> sel;
-        for (auto& a : atoms) if (a.selected) sel.push_back(a.id);
+        std::pmr::vector<int> sel(frameArena.get());
+        for (auto a : atoms) if (a.selected) sel.push_back(a.id);
         if (sel.size() == 2) {
             // Avoid duplicates
             int a = sel[0], b = sel[1];
             if (a > b) std::swap(a,b);
-            auto exists = std::any_of(links.begin(), links.end(), [&](const Link& L){ return L.aId==a && L.bId==b; });
-            if (!exists) links.push_back({a,b});
+            // Linking an already linked pair again cycles single -> double -> triple
+            auto it = std::find_if(links.begin(), links.end(), [&](const Link& L){ return L.aId==a && L.bId==b; });
+            if (it == links.end()) {
+                links.push_back({a,b});
+                stats.linkAdded(a, b);
+                publisher.linkChanged(a, b, 1);
+            } else {
+                it->order = it->order % 3 + 1;
+                publisher.linkChanged(a, b, it->order);
+            }
+            ++sceneVersion;
+        }
+    };
+
+    // Console and --script: each command is one bulk pass over the scene
+    bool consoleOpen = false;
+    std::string consoleInput;
+    std::deque<std::string> consoleLog;
+    FastRng sceneRng(0x5eedu);
+    auto consolePrint = [&](const std::string& line){
+        consoleLog.push_back(line);
+        if (consoleLog.size() > 200) consoleLog.pop_front();
+    };
+
+    auto addAtoms = [&](int element, int count, sf::FloatRect area){
+        int z = ELEMENTS[element].atomicNumber;
+        for (int k = 0; k < count; ++k) {
+            sf::Vector2f pos = clampToCanvas({area.left + sceneRng.uniform() * area.width, area.top + sceneRng.uniform() * area.height}, window.getSize());
+            stats.atomAdded(atoms.add(nextId++, element, pos, makeElectronsForElement(z)));
+        }
+        ++sceneVersion;
+    };
+
+    // Links each selected atom (every atom if none is selected) to its nearest
+    // neighbour within factor x their covalent bond length. The neighbour search is
+    // a parallel pass over a grid; only the dedupe against existing links is serial.
+    auto linkNearest = [&](double factor) -> size_t {
+        size_t n = atoms.size();
+        if (n < 2) return 0;
+        bool anySelected = std::any_of(atoms.begin(), atoms.end(), [](AtomView a){ return a.selected; });
+        std::vector<float> bondRadius(ELEMENTS.size());
+        float maxRadius = 0.f;
+        for (size_t e = 0; e < ELEMENTS.size(); ++e) {
+            bondRadius[e] = (float)(covalentRadius(ELEMENTS[e].atomicNumber) * BOHR_PER_ANGSTROM) * PIXELS_PER_BOHR;
+            maxRadius = std::max(maxRadius, bondRadius[e]);
+        }
+        float reach = (float)factor * 2.f * maxRadius;
+        SpatialGrid neighbours;
+        neighbours.build(atoms, std::max(reach, 1.f));
+        std::vector<int> nearest(n, -1);
+        workerPool().parallelFor(n, 256, [&](size_t b, size_t e){
+            for (size_t i = b; i < e; ++i) {
+                if (anySelected && !atoms[i].selected) continue;
+                float best = 1e30f;
+                neighbours.forEachNear(atoms[i].pos, reach, [&](int j){
+                    if (j == (int)i) return;
+                    float d = length(atoms[j].pos - atoms[i].pos);
+                    float limit = (float)factor * (bondRadius[atoms[i].elementIndex] + bondRadius[atoms[j].elementIndex]);
+                    if (d <= limit && d < best) { best = d; nearest[i] = j; }
+                });
+            }
+        });
+        auto key = [](int a, int b){ return (uint64_t)(uint32_t)std::min(a, b) << 32 | (uint32_t)std::max(a, b); };
+        std::unordered_set<uint64_t> existing;
+        existing.reserve(links.size() + n);
+        for (const auto& L : links) existing.insert(key(L.aId, L.bId));
+        size_t added = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (nearest[i] < 0) continue;
+            int a = atoms[i].id, b = atoms[nearest[i]].id;
+            if (!existing.insert(key(a, b)).second) continue;
+            links.push_back({std::min(a, b), std::max(a, b)});
+            stats.linkAdded(a, b);
+            publisher.linkChanged(a, b, 1);
+            ++added;
+        }
+        if (added) ++sceneVersion;
+        return added;
+    };
+
+    // Queries (console select and the sidebar filter) run against a column view of the scene
+    AtomTable atomTable;
+    std::vector<uint64_t> queryBits;
+    auto runQuery = [&](const std::vector<AtomPredicate>& preds) -> const std::vector<uint64_t>& {
+        atomTable.sync(atoms, links, sceneVersion);
+        atomTable.select(preds, queryBits);
+        return queryBits;
+    };
+    auto queryHit = [](const std::vector<uint64_t>& bits, size_t i){ return (bits[i >> 6] >> (i & 63)) & 1; };
+
+    // Returns the number selected, or -1 with a message for a bad query
+    auto selectWhere = [&](const std::string& query, std::string& error) -> long {
+        std::vector<AtomPredicate> preds;
+        if (query == "none") {
+            for (auto a : atoms) a.selected = false;
+            return 0;
+        }
+        if (!parseAtomQuery(query, preds, error)) return -1;
+        const auto& bits = runQuery(preds);
+        long count = 0;
+        for (size_t i = 0; i < atoms.size(); ++i) count += (atoms[i].selected = queryHit(bits, i));
+        return count;
+    };
+
+    auto countSelected = [&](){
+        return (long)std::count_if(atoms.begin(), atoms.end(), [](AtomView a){ return a.selected; });
+    };
+
+    // Runs one command now and describes what it did; `run` only makes sense inside a timeline
+    auto executeCommand = [&](const SceneCommand& c) -> std::string {
+        std::string error;
+        switch (c.op) {
+        case SceneCommand::Add: {
+            sf::FloatRect canvas = canvasRect();
+            sf::FloatRect area = c.inRect ? c.rect : sf::FloatRect(canvas.left + 40.f, canvas.top + 40.f, canvas.width - 80.f, canvas.height - 80.f);
+            addAtoms(c.element, c.count, area);
+            return "added " + std::to_string(c.count) + " " + ELEMENTS[c.element].symbol;
+        }
+        case SceneCommand::Select: {
+            long n = selectWhere(c.filter, error);
+            return n < 0 ? error : "selected " + std::to_string(n);
+        }
+        case SceneCommand::LinkNearest:
+            return "linked " + std::to_string(linkNearest(c.value)) + " pairs";
+        case SceneCommand::Toggle: {
+            long n = countSelected();
+            toggleActiveSelected();
+            return "toggled " + std::to_string(n);
+        }
+        case SceneCommand::Schedule:
+            return "scheduled " + std::to_string(scheduleSelection(c.value));
+        case SceneCommand::Remove: {
+            long n = countSelected();
+            removeSelected();
+            return "removed " + std::to_string(n);
+        }
+        case SceneCommand::Clear:
+            clearAll();
+            return "cleared";
+        default:
+            return "";
+        }
+    };
+
+    auto runScript = [&](std::vector<SceneCommand> commands) -> Timeline {
+        for (const SceneCommand& c : commands) {
+            if (c.op == SceneCommand::Run) co_await timelines.after(c.value);
+            else consolePrint(executeCommand(c));
         }
     };
 
+    auto runConsoleLine = [&](const std::string& line){
+        consolePrint("> " + line);
+        SceneCommand c;
+        std::string error;
+        if (!parseSceneCommand(line, c, error)) { consolePrint(error); return; }
+        if (c.op == SceneCommand::None) return;
+        if (c.op == SceneCommand::Run) timelines.spawn(runScript({c}));
+        else consolePrint(executeCommand(c));
+    };
+
     // Build buttons
     float x = 16.f, y = 20.f;
     buttons.push_back(makeButton("< Element", font, {x, y}, {140, 32}, [&](){
@@ -213,29 +5984,333 @@ int main() {
     buttons.push_back(makeButton("Remove Selected", font, {x, y}, {300, 32}, removeSelected));
     y += 40;
     buttons.push_back(makeButton("Clear All", font, {x, y}, {300, 32}, clearAll));
+    y += 40;
+    buttons.push_back(makeButton("Orbital Clouds", font, {x, y}, {140, 32}, [&](){ showClouds = !showClouds; }));
+    buttons.back().toggled = &showClouds;
+    buttons.push_back(makeButton("Wavepacket", font, {x + 160, y}, {140, 32}, [&](){
+        showWave = !showWave;
+        if (showWave && !wave.ready()) {
+            sf::FloatRect c = canvasRect();
+            wave.reset(c);
+            wave.launch({c.left + c.width * 0.25f, c.top + c.height * 0.5f}, 4.f, 0.f);
+        }
+    }));
+    buttons.back().toggled = &showWave;
+    y += 40;
+    buttons.push_back(makeButton("HF Energy", font, {x, y}, {140, 32}, computeHartreeFock));
+    buttons.push_back(makeButton("Spectrum", font, {x + 160, y}, {140, 32}, [&](){ showSpectrum = !showSpectrum; }));
+    buttons.back().toggled = &showSpectrum;
+    y += 40;
+    buttons.push_back(makeButton("Photons", font, {x, y}, {140, 32}, [&](){
+        showPhotons = !showPhotons;
+        if (!photons.ready()) photons.init();
+        if (!showPhotons) photons.clear();
+    }));
+    buttons.back().toggled = &showPhotons;
+    buttons.push_back(makeButton("Kinetics", font, {x + 160, y}, {140, 32}, [&](){ runKinetics = !runKinetics; }));
+    buttons.back().toggled = &runKinetics;
+    y += 40;
+    buttons.push_back(makeButton("Ising: Off", font, {x, y}, {140, 32}, nullptr));
+    {
+        size_t ising = buttons.size() - 1;
+        buttons[ising].onClick = [&, ising](){
+            static const char* names[] = { "Ising: Off", "Ising: Metro", "Ising: Wolff", "Ising: SW" };
+            spinMode = spinMode == SpinModel::SwendsenWang ? -1 : spinMode + 1;
+            spinsOn = spinMode >= 0;
+            buttons[ising].label.setString(names[spinMode + 1]);
+        };
+    }
+    buttons.back().toggled = &spinsOn;
+    buttons.push_back(makeButton("T-", font, {x + 160, y}, {65, 32}, [&](){ spins.temperature /= 1.1; }));
+    buttons.push_back(makeButton("T+", font, {x + 235, y}, {65, 32}, [&](){ spins.temperature *= 1.1; }));
+    y += 40;
+    buttons.push_back(makeButton("Bloch Drive", font, {x, y}, {140, 32}, [&](){ showBloch = !showBloch; }));
+    buttons.back().toggled = &showBloch;
+    buttons.push_back(makeButton("g(r) / S(k)", font, {x + 160, y}, {140, 32}, [&](){ showStructure = !showStructure; }));
+    buttons.back().toggled = &showStructure;
+    y += 40;
+    buttons.push_back(makeButton("Export CSV", font, {x, y}, {140, 32}, [&](){
+        if (structure.r.empty()) { status = "Structure: nothing analysed yet"; return; }
+        status = exportStructureCsv(structure, "structure.csv") ? "Wrote structure.csv" : "Could not write structure.csv";
+    }));
+    buttons.push_back(makeButton("Thermal / MSD", font, {x + 160, y}, {140, 32}, [&](){ runThermal = !runThermal; }));
+    buttons.back().toggled = &runThermal;
+    y += 40;
+    buttons.push_back(makeButton("Record", font, {x, y}, {140, 32}, [&](){
+        if (recording) {
+            exporter.stop();
+            status = "Recorded " + std::to_string(exporter.written()) + " frames, " + std::to_string(exporter.dropped()) + " dropped";
+        } else if (!exporter.start(exportConfig)) {
+            status = "Recording: " + exporter.error();
+            return;
+        }
+        recording = !recording;
+    }));
+    buttons.back().toggled = &recording;
     y += 48;
 
+    float titleY = y;
+    y += 28;
+    float statusY = y;
+    y += 44; // two status lines
+    float statsY = y;
+    y += 54; // scene counts
+
     sf::Text elementsLabel = makeText("Elements:", font, 16, sf::Color(220,220,220), {16, y});
+    // Filter box beside the label: the list shows only atoms matching its query, Enter selects them
+    sf::FloatRect filterBox(104.f, y - 1.f, SIDEBAR_W - 120.f, 21.f);
+    bool filterFocused = false;
+    std::string filterText, filterError;
+    std::vector<AtomPredicate> filterPreds;
+    auto setFilter = [&](const std::string& text){
+        filterText = text;
+        filterError.clear();
+        if (!parseAtomQuery(filterText, filterPreds, filterError)) filterPreds.clear();
+    };
     y += 24;
 
     // Atom list starts at yList
     float yList = y;
+    startup.mark("button construction");
+
+    if (glyphWarmup.joinable()) glyphWarmup.join();
+    startup.mark("glyph prewarm wait");
+    // Per-frame systems, in the order they ran before the scheduler. What each one
+    // reads and writes decides which of them may run side by side.
+    using C = Components;
+    SystemScheduler systems;
+    float simTime = 0.f;
+    systems.add("timelines", ~0u, ~0u, [&](){ return timelines.size() > 0; }, [&](){
+        // A script may touch anything, so it runs alone
+        timelines.tick(simTime);
+        std::string error = timelines.takeError();
+        if (!error.empty()) status = "Timeline: " + error;
+    });
+    systems.add("electrons", C::Active, C::Electrons, nullptr, [&](){
+        atoms.world().each<Activity, Shells>([](Entity, Activity& act, Shells& shells){
+            if (!act.active) return;
+            for (auto& e : shells.electrons) e.angle += e.speed * (1.f/60.f);
+        });
+    });
+    systems.add("flash", 0, C::Flash, nullptr, [&](){
+        atoms.world().each<Glow>([](Entity, Glow& g){ g.flash = std::max(0.f, g.flash - 2.f / 60.f); });
+    });
+    systems.add("photons", C::Position | C::Active, C::Photons | C::Flash, [&](){ return showPhotons; }, [&](){
+        // Each active atom emits ~PHOTON_RATE photons per second in random directions
+        const float PHOTON_RATE = 12.f, dt = 1.f / 60.f;
+        for (const auto& a : atoms) {
+            if (!a.active) continue;
+            const auto& pal = photonPalette(a.elementIndex);
+            float expected = PHOTON_RATE * dt;
+            int count = (int)expected + (photonRng.uniform() < expected - (int)expected ? 1 : 0);
+            for (int k = 0; k < count; ++k) {
+                photons.emit(a.pos, photonRng.uniform() * 6.2831853f, pal[photonRng.next() % pal.size()], a.id);
+            }
+        }
+        photons.integrate(dt);
+        grid.build(atoms, 32.f, 16.f);
+        photonHits.clear();
+        photons.absorb(atoms, grid, photonHits);
+        for (int ai : photonHits) atoms[ai].flash = 1.f;
+        photons.collect();
+    });
+    // onBond updates the stats and the publisher's link journal
+    systems.add("kinetics", C::Position | C::Version, C::Links | C::Kinetics | C::Stats | C::Feed, [&](){ return runKinetics; }, [&](){
+        // Formation rates depend on distance, so drift rebuilds the channels too (throttled)
+        bool drifted = kineticsPositions != positionsRevision && simTime - kineticsBuilt >= KINETICS_REBUILD;
+        if (kineticsVersion != sceneVersion || drifted) {
+            kinetics.build(atoms, links, simTime);
+            kineticsVersion = sceneVersion;
+            kineticsPositions = positionsRevision;
+            kineticsBuilt = simTime;
+        }
+        if (kinetics.advance(simTime, &links, 100000) > 0) ++linksRevision;
+    });
+    systems.add("spins", C::Links | C::Version, C::Active | C::Spectrum | C::Spins | C::Stats, [&](){ return spinsOn; }, [&](){
+        if (spinsVersion != sceneVersion || spinsLinks != linksRevision) {
+            spins.build(atoms, links);
+            spinsVersion = sceneVersion;
+            spinsLinks = linksRevision;
+        }
+        spins.sweep((SpinModel::Algorithm)spinMode);
+        // Spin 1 is the active state; flips stay engine-side and don't bump sceneVersion
+        for (size_t i = 0; i < atoms.size(); ++i) {
+            bool up = spins.spinOf(i) == 1;
+            if (up == atoms[i].active) continue;
+            atoms[i].active = up;
+            spectrum.atomActivated(atoms[i].elementIndex, up ? 1 : -1);
+            stats.atomActivated(up ? 1 : -1);
+        }
+    });
+    systems.add("bloch", C::Active | C::Version, C::Bloch | C::Pulses, [&](){ return showBloch; }, [&](){
+        if (blochVersion != sceneVersion) {
+            bloch.build(atoms);
+            blochVersion = sceneVersion;
+        }
+        bloch.syncDrive(atoms);
+        for (size_t i : blochPulses) bloch.pulse(i, 3.14159265f);
+        blochPulses.clear();
+        bloch.step(1.f / 60.f);
+    });
+    systems.add("thermal", C::Version, C::Position | C::Thermal, [&](){ return runThermal; }, [&](){
+        // Engine-driven motion, like spin flips, doesn't bump sceneVersion; an edit restarts the MSD
+        if (thermalVersion != sceneVersion) {
+            thermal.build(atoms, canvasRect());
+            msd.reset(thermal.classStart, thermal.box, thermal.x.data(), thermal.y.data(), thermal.x.size(), 1.f / 60.f);
+            thermalVersion = sceneVersion;
+        }
+        thermal.step(1.f / 60.f);
+        msd.feed(thermal.x.data(), thermal.y.data());
+        thermal.writeBack(atoms);
+        ++positionsRevision;
+    });
+    systems.add("structure", C::Position, C::Structure, nullptr, [&](){
+        // Structure analysis runs on a snapshot in the background; the sim never waits for it
+        if (structureJob.valid() && structureJob.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            structure = structureJob.get();
+        }
+        if (showStructure && !structureJob.valid() && frameIndex % STRUCTURE_EVERY == 0) {
+            std::vector<sf::Vector2f> snapshot(atoms.size());
+            for (size_t i = 0; i < atoms.size(); ++i) snapshot[i] = atoms[i].pos;
+            sf::FloatRect box = canvasRect();
+            structureJob = std::async(std::launch::async, [snapshot = std::move(snapshot), box](){
+                return analyzeStructure(snapshot, box, 300.f, 100);
+            });
+        }
+    });
+    systems.add("hartree-fock", 0, C::Status, nullptr, [&](){
+        if (hfJob.valid() && hfJob.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            HFResult r;
+            try {
+                r = hfJob.get();
+                hfCache[hfJobKey] = r;
+            }
+            catch (const std::exception& e) { r.message = e.what(); }
+            catch (...) { r.message = "unknown error"; }
+            status = describeHF(r);
+        }
+    });
+    systems.add("wavepacket", C::Position, C::Wave, [&](){ return showWave; }, [&](){
+        wave.syncPotential(atoms);
+        wave.step(0.05f); // atomic time units per frame
+    });
+
+    systems.add("publish", C::Position | C::Active | C::Links | C::Bloch, C::Feed, [&](){ return publisher.isOpen(); }, [&](){
+        publisher.publish(simTime, atoms, links, showBloch ? &bloch : nullptr);
+    });
+    if (!shmName.empty()) {
+        if (publisher.open(shmName, shmAtoms, 2 * shmAtoms)) std::cout << "Publishing to shared memory " << shmName << "\n";
+        else {
+            std::cerr << "Shared memory: " << publisher.error() << "\n";
+            status = "Shared memory: " + publisher.error();
+        }
+    }
+
+    if (!scriptPath.empty()) {
+        std::ifstream in(scriptPath);
+        std::vector<SceneCommand> script;
+        std::string error = in ? "" : "cannot open " + scriptPath;
+        if (error.empty() && parseSceneScript(in, script, error)) {
+            timelines.spawn(runScript(std::move(script)));
+        } else {
+            std::cerr << "Script: " << error << "\n";
+            status = "Script: " + error;
+        }
+    }
+
+    // Reused every frame so the steady-state draw loop stays off the heap
+    sf::RectangleShape sidebar;
+    sidebar.setFillColor(sf::Color(22,22,30));
+    TextLine titleLine{makeText("", font, 18, sf::Color::White, {16, titleY}), ""};
+    TextLine statusLine{makeText("", font, 14, sf::Color(200,220,255), {16, statusY}), ""};
+    TextLine filterLine{makeText("", font, 12, sf::Color(230,230,240), {filterBox.left + 4.f, filterBox.top + 3.f}), ""};
+    TextLine isingLine{makeText("", font, 14, sf::Color(200,255,210), {16, statusY + 18}), ""};
+    TextLine statsLines[3];
+    for (int k = 0; k < 3; ++k) statsLines[k] = {makeText("", font, 13, sf::Color(190,190,205), {16, statsY + 18.f * k}), ""};
+    uint64_t statsShown = ~0ull;
+    std::vector<TextLine> listRows;
+    // Overlays: placed each frame, since their panels follow the canvas
+    const size_t CONSOLE_LINES = 10;
+    TextLine msdTitle{makeText("MSD diffusion", font, 14, sf::Color(220,220,220), {0, 0}), "MSD diffusion"};
+    std::vector<TextLine> msdRows;
+    std::vector<TextLine> consoleLines(CONSOLE_LINES, TextLine{makeText("", font, 12, sf::Color(200,200,210), {0, 0}), ""});
+    TextLine consolePrompt{makeText("", font, 12, sf::Color(255,255,180), {0, 0}), ""};
+    std::string consolePromptText;
+    TextLine recLine{makeText("", font, 14, sf::Color(255,90,90), {SIDEBAR_W + 12.f, 10.f}), ""};
+    sf::CircleShape orbitShape, electronShape(4.f);
+    orbitShape.setFillColor(sf::Color(0,0,0,0));
+    orbitShape.setOutlineThickness(1.f);
+    orbitShape.setOutlineColor(sf::Color(60,60,70));
+    electronShape.setOrigin(4.f, 4.f);
+    bool firstFrame = true;
 
     // Main loop
     while (window.isOpen()) {
+        frameArena.reset();
+        profiler.beginFrame();
         sf::Event ev;
         while (window.pollEvent(ev)) {
             if (ev.type == sf::Event::Closed) window.close();
 
+            if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::F3) showProfiler = !showProfiler;
+
+            // ` opens the console; while it's open typed text goes to it
+            if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::Tilde) consoleOpen = !consoleOpen;
+            if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::Escape) {
+                if (!consoleOpen && filterFocused) setFilter("");
+                consoleOpen = filterFocused = false;
+            }
+            if (consoleOpen && ev.type == sf::Event::TextEntered) {
+                sf::Uint32 c = ev.text.unicode;
+                if (c == '\r' || c == '\n') {
+                    if (!consoleInput.empty()) runConsoleLine(consoleInput);
+                    consoleInput.clear();
+                } else if (c == 8) {
+                    if (!consoleInput.empty()) consoleInput.pop_back();
+                } else if (c >= 32 && c < 127 && c != '`') {
+                    consoleInput += (char)c;
+                }
+            } else if (filterFocused && ev.type == sf::Event::TextEntered) {
+                sf::Uint32 c = ev.text.unicode;
+                if (c == '\r' || c == '\n') {
+                    if (filterError.empty()) {
+                        const auto& bits = runQuery(filterPreds);
+                        for (size_t i = 0; i < atoms.size(); ++i) atoms[i].selected = queryHit(bits, i);
+                    }
+                } else if (c == 8) {
+                    if (!filterText.empty()) setFilter(filterText.substr(0, filterText.size() - 1));
+                } else if (c >= 32 && c < 127 && c != '`') {
+                    setFilter(filterText + (char)c);
+                }
+            }
+
+            if (ev.type == sf::Event::KeyPressed && ev.key.code == sf::Keyboard::F12) {
+                const auto& el = ELEMENTS[selectedElement];
+                SceneView view;
+                view.atoms = &atoms;
+                view.links = &links;
+                view.buttons = &buttons;
+                view.title = "Selected: " + el.name + " (" + el.symbol + ")";
+                view.status = status;
+                view.titleY = titleY;
+                view.statusY = statusY;
+                view.listY = yList;
+                view.showRings = !showClouds;
+                rasterizeScene(cpuRenderer, view, (int)window.getSize().x, (int)window.getSize().y);
+                status = writePng("screenshot.png", (const uint8_t*)cpuRenderer.pixels.data(), cpuRenderer.width, cpuRenderer.height)
+                         ? "Wrote screenshot.png" : "Could not write screenshot.png";
+            }
+
             if (ev.type == sf::Event::MouseMoved) {
                 sf::Vector2f m(ev.mouseMove.x, ev.mouseMove.y);
                 for (auto& b : buttons) {
                     b.hover = pointInRect(m, b.box.getGlobalBounds());
                 }
                 if (dragging && draggingId != -1) {
-                    for (auto& a : atoms) {
+                    for (auto a : atoms) {
                         if (a.id == draggingId) {
                             a.pos = clampToCanvas(m - dragOffset, window.getSize());
+                            ++sceneVersion;
                             break;
                         }
                     }
@@ -256,17 +6331,21 @@ int main() {
                 }
                 if (clickedButton) continue;
 
+                filterFocused = filterBox.contains(m);
+                if (filterFocused) continue;
+
                 // Atom list selection (left panel)
                 if (m.x < SIDEBAR_W) {
                     float yy = yList;
-                    for (auto& a : atoms) {
+                    for (int row : listedRows) {
+                        AtomRef a = atoms[row];
                         sf::FloatRect rowRect(16.f, yy, SIDEBAR_W - 32.f, 22.f);
                         if (rowRect.contains(m)) {
                             if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) ||
                                 sf::Keyboard::isKeyPressed(sf::Keyboard::RControl)) {
                                 a.selected = !a.selected;
                             } else {
-                                for (auto& z : atoms) z.selected = false;
+                                for (auto z : atoms) z.selected = false;
                                 a.selected = true;
                             }
                             break;
@@ -276,7 +6355,7 @@ int main() {
                 } else {
                     // Canvas: pick atom by proximity
                     int hitId = -1;
-                    for (auto& a : atoms) {
+                    for (auto a : atoms) {
                         if (length(m - a.pos) <= a.nucleusRadius + 8.f) {
                             hitId = a.id;
                         }
@@ -284,12 +6363,12 @@ int main() {
                     if (hitId != -1) {
                         if (sf::Keyboard::isKeyPressed(sf::Keyboard::LControl) ||
                             sf::Keyboard::isKeyPressed(sf::Keyboard::RControl)) {
-                            for (auto& a : atoms) if (a.id == hitId) a.selected = !a.selected;
+                            for (auto a : atoms) if (a.id == hitId) a.selected = !a.selected;
                         } else {
-                            for (auto& a : atoms) a.selected = (a.id == hitId);
+                            for (auto a : atoms) a.selected = (a.id == hitId);
                         }
                         // Prepare dragging
-                        for (auto& a : atoms) {
+                        for (auto a : atoms) {
                             if (a.id == hitId) {
                                 dragging = true;
                                 draggingId = hitId;
@@ -299,44 +6378,43 @@ int main() {
                         }
                     } else {
                         // Clicked empty canvas: clear selection
-                        for (auto& a : atoms) a.selected = false;
+                        for (auto a : atoms) a.selected = false;
                     }
                 }
             }
 
+            // Right click on the canvas relaunches the wavepacket there
+            if (ev.type == sf::Event::MouseButtonPressed && ev.mouseButton.button == sf::Mouse::Right &&
+                showWave && ev.mouseButton.x > SIDEBAR_W) {
+                wave.launch({(float)ev.mouseButton.x, (float)ev.mouseButton.y}, 4.f, 0.f);
+            }
+
             if (ev.type == sf::Event::MouseButtonReleased && ev.mouseButton.button == sf::Mouse::Left) {
                 dragging = false;
                 draggingId = -1;
             }
         }
 
-        // Time update
-        float t = simClock.getElapsedTime().asSeconds();
-        for (auto& a : atoms) {
-            if (a.scheduledStart && t >= *a.scheduledStart) {
-                a.active = true;
-                a.scheduledStart.reset();
-            }
-            if (a.active) {
-                for (auto& e : a.electrons) {
-                    e.angle += e.speed * (1.f/60.f);
-                }
-            }
-        }
+        profiler.mark("events");
+
+        // Simulation: every engine step is a system; see the registrations above the loop
+        simTime = simClock.getElapsedTime().asSeconds();
+        systems.run(&profiler);
+        ++frameIndex;
 
         // Draw
         window.clear(sf::Color(12, 12, 16));
 
         // Sidebar
-        sf::RectangleShape sidebar;
-        sidebar.setPosition(0,0);
         sidebar.setSize({SIDEBAR_W, (float)window.getSize().y});
-        sidebar.setFillColor(sf::Color(22,22,30));
         window.draw(sidebar);
 
+        if (showWave) wave.draw(window);
+
         // Draw buttons
         for (auto& b : buttons) {
-            b.box.setFillColor(b.hover ? sf::Color(55,55,70) : sf::Color(40,40,50));
+            if (b.toggled && *b.toggled) b.box.setFillColor(b.hover ? sf::Color(70,90,120) : sf::Color(55,75,105));
+            else b.box.setFillColor(b.hover ? sf::Color(55,55,70) : sf::Color(40,40,50));
             window.draw(b.box);
             if (font.getInfo().family != "") window.draw(b.label);
         }
@@ -344,84 +6422,260 @@ int main() {
         // Element display
         if (font.getInfo().family != "") {
             const auto& el = ELEMENTS[selectedElement];
-            auto title = makeText("Selected: " + el.name + " (" + el.symbol + ")", font, 18, sf::Color::White, {16, 20+48+40+40+40+40+40+8});
-            window.draw(title);
+            std::pmr::string title("Selected: ", frameArena.get());
+            title += el.name;
+            title += " (";
+            title += el.symbol;
+            title += ")";
+            titleLine.set(title);
+            window.draw(titleLine.text);
+            if (!status.empty()) {
+                statusLine.set(status);
+                window.draw(statusLine.text);
+            }
+            if (spinsOn) {
+                char line[96];
+                std::snprintf(line, sizeof line, "Ising T=%.2f  m=%.3f  E/N=%.3f", spins.temperature,
+                              spins.magnetization(), spins.size() ? spins.energy() / spins.size() : 0.0);
+                isingLine.set(line);
+                window.draw(isingLine.text);
+            }
+            // The counts are maintained by the edits; the text is only rebuilt when they change
+            if (stats.revision() != statsShown) {
+                statsShown = stats.revision();
+                std::pmr::string perElement(frameArena.get());
+                for (size_t e = 0; e < ELEMENTS.size(); ++e) {
+                    if (!stats.elementCount((int)e)) continue;
+                    if (!perElement.empty()) perElement += "  ";
+                    perElement += ELEMENTS[e].symbol;
+                    perElement += ' ';
+                    perElement += std::to_string(stats.elementCount((int)e));
+                }
+                char line[128];
+                std::snprintf(line, sizeof line, "Atoms %ld: %ld active, %ld idle, %ld scheduled", stats.atomCount(),
+                              stats.activeCount(), stats.atomCount() - stats.activeCount(), stats.scheduledCount());
+                statsLines[0].set(line);
+                std::snprintf(line, sizeof line, "Links %ld, molecules %d, largest %d", stats.linkCount(),
+                              stats.molecules(), stats.largestComponent());
+                statsLines[1].set(line);
+                if (perElement.size() > 44) { perElement.resize(41); perElement += "..."; }
+                statsLines[2].set(perElement);
+            }
+            for (auto& l : statsLines) window.draw(l.text);
         }
 
-        // Atom list
+        // Atom list, narrowed by the filter box when it holds a valid query
         float yy = yList;
-        if (font.getInfo().family != "") window.draw(elementsLabel);
-        for (auto& a : atoms) {
-            const Element& el = ELEMENTS[a.elementIndex];
-            sf::Text row = makeText(
-                "ID " + std::to_string(a.id) + "  " + el.symbol + "  " + (a.active ? "[Active]" : "[Idle]"),
-                font, 14, a.selected ? sf::Color(255,255,180) : sf::Color(200,200,210),
-                {16, yy});
-            if (font.getInfo().family != "") window.draw(row);
+        if (font.getInfo().family != "") {
+            window.draw(elementsLabel);
+            sf::RectangleShape box({filterBox.width, filterBox.height});
+            box.setPosition(filterBox.left, filterBox.top);
+            box.setFillColor(sf::Color(24,24,32));
+            box.setOutlineThickness(1.f);
+            box.setOutlineColor(!filterError.empty() ? sf::Color(200,90,90) : filterFocused ? sf::Color(150,150,190) : sf::Color(70,70,90));
+            window.draw(box);
+            bool hint = filterText.empty() && !filterFocused;
+            if (hint) {
+                filterLine.set("filter: element=O degree>1");
+            } else if (!filterFocused) {
+                filterLine.set(filterText);
+            } else {
+                // Compare against "<text>_" in place so an unchanged edit builds no string
+                std::string_view cur = filterLine.shown;
+                if (cur.size() != filterText.size() + 1 || cur.back() != '_' || cur.substr(0, filterText.size()) != filterText)
+                    filterLine.set(filterText + "_");
+            }
+            filterLine.text.setFillColor(hint ? sf::Color(110,110,130) : sf::Color(230,230,240));
+            window.draw(filterLine.text);
+        }
+        listedRows.clear();
+        if (!filterText.empty() && filterError.empty()) {
+            const auto& bits = runQuery(filterPreds);
+            for (size_t i = 0; i < atoms.size(); ++i) if (queryHit(bits, i)) listedRows.push_back((int)i);
+        } else {
+            for (size_t i = 0; i < atoms.size(); ++i) listedRows.push_back((int)i);
+        }
+        while (listRows.size() < listedRows.size()) listRows.push_back({makeText("", font, 14, sf::Color::White, {16, 0}), ""});
+        for (size_t k = 0; k < listedRows.size(); ++k) {
+            AtomView a = atoms[listedRows[k]];
+            TextLine& row = listRows[k];
+            row.set(atomListRow(a, frameArena.get()));
+            row.text.setFillColor(a.selected ? sf::Color(255,255,180) : sf::Color(200,200,210));
+            row.text.setPosition(16, yy);
+            if (font.getInfo().family != "") window.draw(row.text);
             yy += 24.f;
         }
-
-        // Draw links (interactions)
-        for (const auto& L : links) {
-            const Atom* A = nullptr;
-            const Atom* B = nullptr;
-            for (const auto& a : atoms) {
-                if (a.id == L.aId) A = &a;
-                if (a.id == L.bId) B = &a;
-            }
-            if (A && B) {
-                sf::Vertex line[] = {
-                    sf::Vertex(A->pos, sf::Color(120,200,255)),
-                    sf::Vertex(B->pos, sf::Color(120,200,255))
-                };
-                window.draw(line, 2, sf::Lines);
-            }
+        if (showStructure) {
+            float h = (float)window.getSize().y;
+            sf::RectangleShape backdrop({SIDEBAR_W, 224.f});
+            backdrop.setPosition(0.f, h - 224.f);
+            backdrop.setFillColor(sf::Color(22,22,30));
+            window.draw(backdrop);
+            drawStructurePlots(window, font, structure, {10.f, h - 216.f, SIDEBAR_W - 20.f, 208.f});
         }
 
-        // Draw atoms
-        for (auto& a : atoms) {
-            const Element& el = ELEMENTS[a.elementIndex];
+        // Draw links (interactions)
+        linkBatch.sync(atoms, links);
+        linkBatch.draw(window);
 
-            // Nucleus
-            sf::CircleShape nucleus(a.nucleusRadius);
-            nucleus.setOrigin(a.nucleusRadius, a.nucleusRadius);
-            nucleus.setPosition(a.pos);
-            nucleus.setFillColor(a.selected ? sf::Color(el.color.r, el.color.g, el.color.b, 255)
-                                            : sf::Color(el.color.r, el.color.g, el.color.b, 220));
-            nucleus.setOutlineThickness(a.active ? 3.f : 1.f);
-            nucleus.setOutlineColor(a.active ? sf::Color(255,255,180) : sf::Color(90,90,110));
-            window.draw(nucleus);
+        if (showClouds) drawOrbitalClouds(window, atoms, cloudCache);
 
-            // Orbits (rings)
-            for (const auto& e : a.electrons) {
-                sf::CircleShape orbit(e.radius);
-                orbit.setOrigin(e.radius, e.radius);
-                orbit.setPosition(a.pos);
-                orbit.setFillColor(sf::Color(0,0,0,0));
-                orbit.setOutlineThickness(1.f);
-                orbit.setOutlineColor(sf::Color(60,60,70));
-                window.draw(orbit);
+        // Draw atoms: orbits and electrons per atom, then every nucleus in one batch on top
+        if (!nucleusAtlas.ready()) nucleusAtlas.build(font);
+        nucleusAtlas.begin();
+        for (size_t i = 0; i < atoms.size(); ++i) {
+            AtomView a = atoms[i];
+            sf::Color body = sf::Color::White;
+            if (showBloch && i < bloch.size()) {
+                // Brightness follows the excited-state population
+                float level = 0.25f + 0.75f * bloch.excited(i);
+                body.r = body.g = body.b = (sf::Uint8)(255 * level);
             }
+            nucleusAtlas.add(a, body, nucleusOutlineColor(a));
 
-            // Electrons
-            for (const auto& e : a.electrons) {
-                float ex = a.pos.x + std::cos(e.angle) * e.radius;
-                float ey = a.pos.y + std::sin(e.angle) * e.radius;
-                sf::CircleShape electron(4.f);
-                electron.setOrigin(4.f, 4.f);
-                electron.setPosition(ex, ey);
-                electron.setFillColor(a.active ? sf::Color(180,255,255) : sf::Color(160,180,200));
-                window.draw(electron);
-            }
+            // Orbits (rings) and electrons; the cloud mode replaces both
+            if (!showClouds) {
+                for (const auto& e : a.electrons) {
+                    orbitShape.setRadius(e.radius);
+                    orbitShape.setOrigin(e.radius, e.radius);
+                    orbitShape.setPosition(a.pos);
+                    window.draw(orbitShape);
+                }
 
-            // Labels
-            if (font.getInfo().family != "") {
-                sf::Text label = makeText(ELEMENTS[a.elementIndex].symbol, font, 14, sf::Color::Black, {a.pos.x - 8, a.pos.y - 10});
-                window.draw(label);
+                // Electrons
+                electronShape.setFillColor(a.active ? sf::Color(180,255,255) : sf::Color(160,180,200));
+                for (const auto& e : a.electrons) {
+                    float ex = a.pos.x + std::cos(e.angle) * e.radius;
+                    float ey = a.pos.y + std::sin(e.angle) * e.radius;
+                    electronShape.setPosition(ex, ey);
+                    window.draw(electronShape);
+                }
             }
         }
+        nucleusAtlas.draw(window);
+
+        if (showPhotons) photons.draw(window);
+
+        if (showSpectrum) {
+            sf::FloatRect c = canvasRect();
+            spectrum.draw(window, font, {c.left + 10.f, c.top + c.height - 90.f, c.width - 20.f, 80.f});
+        }
 
+        if (runThermal && font.getInfo().family != "") {
+            // Diffusion per element present, measured vs. the Brownian input
+            sf::FloatRect canvas = canvasRect();
+            float px = canvas.left + canvas.width - 290.f;
+            size_t shownRows = 0;
+            for (size_t e = 0; e < ELEMENTS.size(); ++e) {
+                if (thermal.classStart.size() <= e + 1 || thermal.classStart[e + 1] == thermal.classStart[e]) continue;
+                char line[96];
+                std::snprintf(line, sizeof line, "%-3s D = %7.1f px^2/s  (input %.1f)", ELEMENTS[e].symbol.c_str(),
+                              msd.diffusion(e), thermal.diffusionOf((int)e));
+                if (msdRows.size() <= shownRows) msdRows.push_back({makeText("", font, 12, sf::Color(190,220,255), {0, 0}), ""});
+                msdRows[shownRows].set(line);
+                msdRows[shownRows].text.setPosition(px + 8.f, 34.f + 18.f * shownRows);
+                ++shownRows;
+            }
+            sf::RectangleShape panel({280.f, 24.f + 18.f * shownRows});
+            panel.setPosition(px, 10.f);
+            panel.setFillColor(sf::Color(16, 16, 22, 200));
+            window.draw(panel);
+            msdTitle.text.setPosition(px + 8.f, 14.f);
+            window.draw(msdTitle.text);
+            for (size_t r = 0; r < shownRows; ++r) window.draw(msdRows[r].text);
+        }
+        if (consoleOpen && font.getInfo().family != "") {
+            sf::FloatRect canvas = canvasRect();
+            float top = canvas.top + canvas.height - 24.f - 16.f * CONSOLE_LINES;
+            sf::RectangleShape panel({canvas.width - 20.f, 16.f * CONSOLE_LINES + 18.f});
+            panel.setPosition(canvas.left + 10.f, top - 4.f);
+            panel.setFillColor(sf::Color(10, 10, 14, 230));
+            panel.setOutlineThickness(1.f);
+            panel.setOutlineColor(sf::Color(90,90,110));
+            window.draw(panel);
+            size_t first = consoleLog.size() > CONSOLE_LINES ? consoleLog.size() - CONSOLE_LINES : 0;
+            for (size_t k = first; k < consoleLog.size(); ++k) {
+                TextLine& line = consoleLines[k - first];
+                line.set(consoleLog[k]);
+                line.text.setPosition(canvas.left + 16.f, top + 16.f * (k - first));
+                window.draw(line.text);
+            }
+            consolePromptText.assign("> ");
+            consolePromptText += consoleInput;
+            consolePromptText += '_';
+            consolePrompt.set(consolePromptText);
+            consolePrompt.text.setPosition(canvas.left + 16.f, top + 16.f * CONSOLE_LINES);
+            window.draw(consolePrompt.text);
+        }
+        if (showProfiler && font.getInfo().family != "") {
+            // Per-frame averages of the last window; the cells are only rebuilt when it's published
+            sf::FloatRect canvas = canvasRect();
+            sf::RectangleShape panel({440.f, 28.f + 16.f * (profiler.latest().size() + 1)});
+            panel.setPosition(canvas.left + 10.f, 34.f);
+            panel.setFillColor(sf::Color(16, 16, 22, 210));
+            window.draw(panel);
+            for (auto& cell : profilerCells) window.draw(cell);
+        }
+        profiler.mark("draw");
+        if (recording) {
+            // The readback is the only synchronous part; encoding and I/O happen on the exporter's threads
+            sf::Vector2u size = window.getSize();
+            if (captureTexture.getSize() != size) captureTexture.create(size.x, size.y);
+            captureTexture.update(window);
+            sf::Image frame = captureTexture.copyToImage();
+            exporter.submit(frame.getPixelsPtr(), (int)size.x, (int)size.y);
+        }
+        if (recording && font.getInfo().family != "") {
+            // Drawn after the capture, so it shows on screen but not in the recording
+            char rec[96];
+            std::snprintf(rec, sizeof rec, "REC %ld written, %ld dropped", exporter.written(), exporter.dropped());
+            recLine.set(rec);
+            window.draw(recLine.text);
+        }
         window.display();
+        profiler.mark("present");
+        if (profiler.frameCount() == PROFILE_WINDOW) {
+            const auto& stats = profiler.publish();
+            if (allocReport) profiler.report(std::cerr);
+            const PerfCounters& pc = profiler.counters();
+            bool ipc = pc.available(PerfCounters::Cycles) && pc.available(PerfCounters::Instructions);
+            auto perKilo = [&](const PhaseProfiler::Stats& st, int c) -> std::string {
+                if (!pc.available(c) || !pc.available(PerfCounters::Instructions) || st.counters[PerfCounters::Instructions] <= 0) return "-";
+                char v[32];
+                std::snprintf(v, sizeof v, "%.2f", 1000.0 * st.counters[c] / st.counters[PerfCounters::Instructions]);
+                return v;
+            };
+            profilerCells.clear();
+            float px = SIDEBAR_W + 18.f, py = 38.f;
+            const char* headers[] = { "phase", "ms", "allocs", "IPC", "LLC/ki", "br/ki" };
+            const float columns[] = { 0.f, 120.f, 180.f, 240.f, 300.f, 370.f };
+            for (int c = 0; c < 6; ++c)
+                profilerCells.push_back(makeText(headers[c], font, 12, sf::Color(220,220,220), {px + columns[c], py}));
+            for (size_t r = 0; r < stats.size(); ++r) {
+                const auto& st = stats[r];
+                char ms[32], allocs[32], ipcText[32];
+                std::snprintf(ms, sizeof ms, "%.3f", st.ms);
+                std::snprintf(allocs, sizeof allocs, "%.1f", st.allocations);
+                if (ipc && st.counters[PerfCounters::Cycles] > 0)
+                    std::snprintf(ipcText, sizeof ipcText, "%.2f", st.counters[PerfCounters::Instructions] / st.counters[PerfCounters::Cycles]);
+                else std::snprintf(ipcText, sizeof ipcText, "-");
+                std::string name = st.name;
+                if (name.size() > 18) name = name.substr(0, 16) + "..";  // waves are named after all their systems
+                std::string cells[] = { name, ms, allocs, ipcText, perKilo(st, PerfCounters::LlcMisses), perKilo(st, PerfCounters::BranchMisses) };
+                for (int c = 0; c < 6; ++c)
+                    profilerCells.push_back(makeText(cells[c], font, 12, sf::Color(190,220,255), {px + columns[c], py + 16.f * (r + 1)}));
+            }
+            if (!pc.any())
+                profilerCells.push_back(makeText("hardware counters unavailable", font, 12, sf::Color(255,180,120), {px, py + 16.f * (stats.size() + 1)}));
+        }
+        if (firstFrame) {
+            firstFrame = false;
+            startup.mark("first frame");
+            if (startupReport) {
+                startup.report(std::cerr);
+                std::cerr << "Startup: first frame after " << (int)startup.last << " ms\n";
+            }
+        }
     }
 
     return 0;
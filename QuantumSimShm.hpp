@@ -0,0 +1,259 @@
+// Live scene feed for processes running next to QuantumSim (started with
+// --shm <name>). The sandbox writes every simulation step straight into one slot
+// of a ring in POSIX shared memory; this header holds the layout both sides agree
+// on and a small reader. Readers never block the writer: each slot is a seqlock,
+// so a reader copies the slot out and then checks that nothing moved under it.
+//
+//   ShmReader feed;
+//   if (feed.open("qsim")) {
+//       ShmSnapshot s;
+//       ShmLinkSet links;
+//       while (feed.next(s)) { links.apply(s); ... }
+//   }
+//
+// Link the reader with -lrt on glibc older than 2.34.
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define QS_SHM_POSIX 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t SHM_MAGIC = 0x4d495351; // "QSIM"
+static const uint32_t SHM_VERSION = 1;
+
+// Per-atom flag bits
+enum : uint8_t { SHM_ATOM_ACTIVE = 1, SHM_ATOM_SELECTED = 2 };
+// Per-slot flag bits. A keyframe's link region is the whole link list rather than
+// the changes since the previous step; truncated means the scene outgrew the
+// capacities and only the first atoms (or links) are in the slot.
+enum : uint32_t { SHM_KEYFRAME = 1, SHM_TRUNCATED = 2 };
+
+struct ShmLinkDelta {
+    int32_t aId, bId;
+    int32_t order; // 1-3; 0 when the link was removed
+};
+
+// At offset 0 of the segment; written once before any slot
+struct ShmHeader {
+    uint32_t magic, version;
+    uint32_t slotCount;
+    uint32_t atomCapacity, linkCapacity;
+    uint32_t keyframeInterval; // steps between keyframes, at most slotCount / 2
+    uint64_t slotBytes;
+    uint64_t firstSlot;              // byte offset of slot 0
+    std::atomic<uint64_t> published; // steps completed; step s is in slot s % slotCount
+};
+
+// Start of every slot. seq is odd while the writer is inside the slot and
+// 2 * step + 2 once step is complete.
+struct ShmSlotHeader {
+    std::atomic<uint64_t> seq;
+    uint64_t step;
+    double time;          // simulation seconds
+    uint32_t atomCount;
+    uint32_t linkCount;   // links in the scene after this step
+    uint32_t deltaCount;  // entries in the link region
+    uint32_t flags;
+};
+
+// Byte offsets of the SoA columns inside a slot, each 64-byte aligned
+struct ShmSlotLayout {
+    size_t id, x, y, excited, phase, flags, links, bytes;
+};
+
+inline ShmSlotLayout shmSlotLayout(uint32_t atomCapacity, uint32_t linkCapacity) {
+    auto align = [](size_t n){ return (n + 63) & ~(size_t)63; };
+    ShmSlotLayout l;
+    l.id = align(sizeof(ShmSlotHeader));
+    l.x = align(l.id + atomCapacity * sizeof(int32_t));
+    l.y = align(l.x + atomCapacity * sizeof(float));
+    l.excited = align(l.y + atomCapacity * sizeof(float));   // Bloch excited population, 0 with Bloch off
+    l.phase = align(l.excited + atomCapacity * sizeof(float)); // Bloch coherence phase atan2(v, u)
+    l.flags = align(l.phase + atomCapacity * sizeof(float));
+    l.links = align(l.flags + atomCapacity);
+    l.bytes = align(l.links + linkCapacity * sizeof(ShmLinkDelta));
+    return l;
+}
+
+inline std::string shmObjectName(const std::string& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+// One step copied out of the ring
+struct ShmSnapshot {
+    uint64_t step = 0;
+    double time = 0.0;
+    uint32_t flags = 0;
+    uint32_t linkCount = 0;
+    bool gap = false; // steps were skipped since the previous next()
+    std::vector<int32_t> id;
+    std::vector<float> x, y, excited, phase;
+    std::vector<uint8_t> atomFlags;
+    std::vector<ShmLinkDelta> links; // full list on keyframes, changes otherwise
+};
+
+// The link list rebuilt from the deltas. After a gap it waits for the next
+// keyframe; synced() says whether links() matches the scene.
+class ShmLinkSet {
+public:
+    bool synced() const { return isSynced; }
+    const std::unordered_map<uint64_t, int32_t>& links() const { return byPair; } // key(aId, bId) -> order
+
+    static uint64_t key(int32_t a, int32_t b) {
+        if (a > b) std::swap(a, b);
+        return (uint64_t)(uint32_t)a << 32 | (uint32_t)b;
+    }
+
+    void apply(const ShmSnapshot& s) {
+        if (s.gap) isSynced = false;
+        if (s.flags & SHM_KEYFRAME) {
+            byPair.clear();
+            isSynced = !(s.flags & SHM_TRUNCATED);
+        } else if (!isSynced) {
+            return;
+        }
+        for (const auto& d : s.links) {
+            if (d.order) byPair[key(d.aId, d.bId)] = d.order;
+            else byPair.erase(key(d.aId, d.bId));
+        }
+    }
+
+private:
+    std::unordered_map<uint64_t, int32_t> byPair;
+    bool isSynced = false;
+};
+
+class ShmReader {
+public:
+    ~ShmReader() { close(); }
+
+    bool isOpen() const { return base != nullptr; }
+    const std::string& error() const { return lastError; }
+    const ShmHeader* header() const { return (const ShmHeader*)base; }
+
+    bool open(const std::string& name) {
+        close();
+#ifdef QS_SHM_POSIX
+        int fd = shm_open(shmObjectName(name).c_str(), O_RDONLY, 0);
+        if (fd < 0) { lastError = "no feed named " + name; return false; }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ShmHeader)) {
+            ::close(fd);
+            lastError = "feed not ready";
+            return false;
+        }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) { lastError = "mmap failed"; return false; }
+        base = (const uint8_t*)p;
+        bytes = (size_t)st.st_size;
+        const ShmHeader* h = header();
+        if (h->magic != SHM_MAGIC || h->version != SHM_VERSION ||
+            h->firstSlot + h->slotBytes * h->slotCount > bytes) {
+            close();
+            lastError = "not a QuantumSim feed (or a different version)";
+            return false;
+        }
+        layout = shmSlotLayout(h->atomCapacity, h->linkCapacity);
+        nextStep = 0;
+        return true;
+#else
+        (void)name;
+        lastError = "shared memory needs a POSIX system";
+        return false;
+#endif
+    }
+
+    void close() {
+#ifdef QS_SHM_POSIX
+        if (base) munmap((void*)base, bytes);
+#endif
+        base = nullptr;
+        bytes = 0;
+    }
+
+    // Steps the writer has completed
+    uint64_t published() const { return base ? header()->published.load(std::memory_order_acquire) : 0; }
+
+    // Copies `step` if it is still in the ring. False when it isn't published yet,
+    // was overwritten, or the writer lapped the copy; retry or move on.
+    bool read(uint64_t step, ShmSnapshot& out) const {
+        if (!base || step >= published()) return false;
+        const ShmHeader* h = header();
+        const uint8_t* slot = base + h->firstSlot + (step % h->slotCount) * h->slotBytes;
+        const ShmSlotHeader* sh = (const ShmSlotHeader*)slot;
+        uint64_t expect = 2 * step + 2;
+        if (sh->seq.load(std::memory_order_acquire) != expect) return false;
+        uint32_t n = std::min(sh->atomCount, h->atomCapacity), m = std::min(sh->deltaCount, h->linkCapacity);
+        out.step = sh->step;
+        out.time = sh->time;
+        out.flags = sh->flags;
+        out.linkCount = sh->linkCount;
+        column(out.id, slot + layout.id, n);
+        column(out.x, slot + layout.x, n);
+        column(out.y, slot + layout.y, n);
+        column(out.excited, slot + layout.excited, n);
+        column(out.phase, slot + layout.phase, n);
+        column(out.atomFlags, slot + layout.flags, n);
+        column(out.links, slot + layout.links, m);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return sh->seq.load(std::memory_order_relaxed) == expect;
+    }
+
+    // The step after the last one returned, or the newest if that one is gone
+    // (out.gap is set then). False when there is nothing new yet.
+    bool next(ShmSnapshot& out) {
+        bool skipped = false;
+        for (;;) {
+            uint64_t done = published();
+            if (nextStep >= done) return false;
+            // Step done is in progress; once it reaches nextStep's slot, that step is lost
+            if (done - nextStep >= header()->slotCount) { nextStep = done - 1; skipped = true; }
+            if (read(nextStep, out)) {
+                out.gap = skipped;
+                ++nextStep;
+                return true;
+            }
+            // Lapped mid-copy: jump to the newest step
+            skipped = true;
+            nextStep = published() - 1;
+        }
+    }
+
+    // Copies the newest complete step
+    bool latest(ShmSnapshot& out) const {
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            uint64_t done = published();
+            if (done == 0) return false;
+            if (read(done - 1, out)) return true;
+        }
+        return false;
+    }
+
+private:
+    template <class T>
+    static void column(std::vector<T>& dst, const uint8_t* src, size_t n) {
+        dst.resize(n);
+        if (n) std::memcpy(dst.data(), src, n * sizeof(T));
+    }
+
+    const uint8_t* base = nullptr;
+    size_t bytes = 0;
+    ShmSlotLayout layout{};
+    uint64_t nextStep = 0;
+    std::string lastError;
+};